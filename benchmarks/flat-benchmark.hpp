@@ -0,0 +1,147 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_FLAT_BENCHMARK
+#define DRO_FLAT_BENCHMARK
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "dro/flat-rb-tree.hpp"
+#include "flat-perf-counters.hpp"
+
+#if __has_include(<boost/container/flat_map.hpp> )
+#include <boost/container/flat_map.hpp>
+#endif
+
+#if __has_include(<folly/container/heap_vector_types.h> )
+#include <folly/container/heap_vector_types.h>
+#endif
+
+struct alignas(4) Test {
+  int x_;
+  Test() = default;
+  Test(int x) : x_(x) {}
+  auto operator<=>(const Test&) const = default;
+};
+
+// Sizes of benchmarks/results
+inline const std::vector<std::int64_t> benchmarkSizes {
+    100,     500,       1'000,     5'000,     10'000,    50'000,
+    100'000, 500'000, 1'000'000, 5'000'000, 10'000'000};
+
+// Sorted vector maps insert in linear time, their runs stop at the sizes of
+// benchmarks/results. Workloads with writes to a full map stop earlier.
+template <typename Map> struct BenchmarkMap {
+  constexpr static std::int64_t max_size_       = 10'000'000;
+  constexpr static std::int64_t max_write_size_ = 10'000'000;
+};
+
+using DroFlatMap = dro::FlatMap<Test, Test, uint32_t>;
+using StdMap     = std::map<Test, Test>;
+
+template <typename Balance>
+using DroBalanceMap = dro::FlatMap<
+    Test, Test, uint32_t, std::less<Test>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<Test, Test>, uint32_t>>,
+    dro::NoLookupIndex, Balance>;
+
+#if __has_include(<boost/container/flat_map.hpp>)
+using BoostFlatMap = boost::container::flat_map<Test, Test>;
+
+template <> struct BenchmarkMap<BoostFlatMap> {
+  constexpr static std::int64_t max_size_       = 1'000'000;
+  constexpr static std::int64_t max_write_size_ = 100'000;
+};
+#endif
+
+#if __has_include(<folly/container/heap_vector_types.h>)
+using FollyHeapVectorMap = folly::heap_vector_map<Test, Test>;
+
+template <> struct BenchmarkMap<FollyHeapVectorMap> {
+  constexpr static std::int64_t max_size_       = 100'000;
+  constexpr static std::int64_t max_write_size_ = 100'000;
+};
+#endif
+
+// Same keys for every container of a size
+inline std::vector<int> randomKeys(std::size_t count, std::uint64_t seed = 1) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<int> dist;
+  std::vector<int> keys(count);
+  for (auto& key : keys) { key = dist(gen); }
+  return keys;
+}
+
+// Starts the hardware counters of --perf_counters, right before the timed loop
+inline void startCounters() { perfCounters().start(); }
+
+// Pauses the clock and the hardware counters around untimed work
+inline void pauseTiming(benchmark::State& state) {
+  state.PauseTiming();
+  perfCounters().pause();
+}
+
+inline void resumeTiming(benchmark::State& state) {
+  perfCounters().resume();
+  state.ResumeTiming();
+}
+
+// Time per operation next to the time per iteration, and the repetition
+// summaries past the mean, median and standard deviation. With
+// --perf_counters every hardware count is per operation as well.
+inline void setOperations(benchmark::State& state, std::int64_t operations) {
+  perfCounters().report(state, operations);
+  state.SetItemsProcessed(state.iterations() * operations);
+  state.counters["per_op"] = benchmark::Counter(
+      static_cast<double>(operations),
+      benchmark::Counter::kIsIterationInvariantRate |
+          benchmark::Counter::kInvert);
+}
+
+inline double benchmarkMin(const std::vector<double>& values) {
+  return *std::min_element(values.begin(), values.end());
+}
+
+inline double benchmarkMax(const std::vector<double>& values) {
+  return *std::max_element(values.begin(), values.end());
+}
+
+// Sizes up to max, with the min and max of the repetitions
+inline void benchmarkArgs(benchmark::internal::Benchmark* bench,
+                          std::int64_t max) {
+  for (auto size : benchmarkSizes) {
+    if (size <= max) {
+      bench->Arg(size);
+    }
+  }
+  bench->ComputeStatistics("min", benchmarkMin)
+      ->ComputeStatistics("max", benchmarkMax)
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+}
+
+template <typename Map>
+void benchmarkMapArgs(benchmark::internal::Benchmark* bench) {
+  benchmarkArgs(bench, BenchmarkMap<Map>::max_size_);
+}
+
+template <typename Map>
+void benchmarkWriteArgs(benchmark::internal::Benchmark* bench) {
+  benchmarkArgs(bench, BenchmarkMap<Map>::max_write_size_);
+}
+
+#endif
@@ -0,0 +1,156 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include <algorithm>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "flat-benchmark.hpp"
+
+// Sweeps the key type, the value size and MaxSize of dro::FlatMap. A value
+// size of zero is a dro::FlatSet. Rotations and relocations move the whole
+// pair, so the cost of a write grows with the payload.
+
+struct Key16 {
+  std::int64_t high_ {};
+  std::int64_t low_ {};
+  auto operator<=>(const Key16&) const = default;
+};
+
+template <std::size_t Bytes> struct Payload {
+  std::array<std::byte, Bytes> bytes_ {};
+};
+
+struct Int32Key {
+  using type = std::int32_t;
+  static type make(int key) { return key; }
+};
+
+struct Int64Key {
+  using type = std::int64_t;
+  static type make(int key) { return static_cast<type>(key) << 31; }
+};
+
+struct Struct16Key {
+  using type = Key16;
+  static type make(int key) { return {key, ~static_cast<std::int64_t>(key)}; }
+};
+
+// Fits the small string buffer
+struct ShortStringKey {
+  using type = std::string;
+  static type make(int key) { return std::to_string(key); }
+};
+
+// On the heap, and a shared prefix compares 48 bytes before the number
+struct LongStringKey {
+  using type = std::string;
+  static type make(int key) {
+    return std::string(48, 'k') + std::to_string(key);
+  }
+};
+
+template <typename KeyKind, std::size_t ValueBytes, typename MaxSize>
+using MatrixTree = std::conditional_t<
+    ValueBytes == 0, dro::FlatSet<typename KeyKind::type, MaxSize>,
+    dro::FlatMap<typename KeyKind::type, Payload<ValueBytes>, MaxSize>>;
+
+template <typename KeyKind>
+std::vector<typename KeyKind::type> matrixKeys(std::size_t count) {
+  std::vector<typename KeyKind::type> keys;
+  keys.reserve(count);
+  for (int key : randomKeys(count)) { keys.push_back(KeyKind::make(key)); }
+  return keys;
+}
+
+template <std::size_t ValueBytes, typename Tree, typename Key>
+void matrixInsert(Tree& tree, const Key& key) {
+  if constexpr (ValueBytes == 0) {
+    tree.insert(key);
+  } else {
+    tree.emplace(key, Payload<ValueBytes> {});
+  }
+}
+
+// Bytes of the object, the allocation and the heap of the keys, per element
+template <typename Tree>
+void setBytesPerElement(benchmark::State& state, const Tree& tree) {
+  state.counters["bytes_per_elem"] =
+      static_cast<double>(tree.memory_usage().total_) /
+      static_cast<double>(std::max<std::size_t>(tree.size(), 1));
+}
+
+template <typename KeyKind, std::size_t ValueBytes, typename MaxSize>
+void benchmarkMatrixInsert(benchmark::State& state) {
+  using Tree = MatrixTree<KeyKind, ValueBytes, MaxSize>;
+  auto keys  = matrixKeys<KeyKind>(static_cast<std::size_t>(state.range(0)));
+  startCounters();
+  for (auto _ : state) {
+    auto tree = std::make_unique<Tree>();
+    for (const auto& key : keys) { matrixInsert<ValueBytes>(*tree, key); }
+    benchmark::DoNotOptimize(tree.get());
+    pauseTiming(state);
+    setBytesPerElement(state, *tree);
+    tree.reset();
+    resumeTiming(state);
+  }
+  setOperations(state, state.range(0));
+}
+
+template <typename KeyKind, std::size_t ValueBytes, typename MaxSize>
+void benchmarkMatrixFind(benchmark::State& state) {
+  using Tree = MatrixTree<KeyKind, ValueBytes, MaxSize>;
+  auto keys  = matrixKeys<KeyKind>(static_cast<std::size_t>(state.range(0)));
+  Tree tree;
+  for (const auto& key : keys) { matrixInsert<ValueBytes>(tree, key); }
+  startCounters();
+  for (auto _ : state) {
+    for (const auto& key : keys) {
+      auto it = tree.find(key);
+      benchmark::DoNotOptimize(it);
+    }
+  }
+  setBytesPerElement(state, tree);
+  setOperations(state, state.range(0));
+}
+
+// A million elements of 256 byte values already take a quarter gigabyte
+template <typename MaxSize>
+void benchmarkMatrixArgs(benchmark::internal::Benchmark* bench) {
+  benchmarkArgs(bench, std::min<std::int64_t>(
+                           1'000'000, std::numeric_limits<MaxSize>::max()));
+}
+
+#define DRO_BENCHMARK_MATRIX(KeyKind, ValueBytes, MaxSize)                     \
+  BENCHMARK_TEMPLATE(benchmarkMatrixInsert, KeyKind, ValueBytes, MaxSize)      \
+      ->Apply(benchmarkMatrixArgs<MaxSize>);                                   \
+  BENCHMARK_TEMPLATE(benchmarkMatrixFind, KeyKind, ValueBytes, MaxSize)        \
+      ->Apply(benchmarkMatrixArgs<MaxSize>)
+
+#define DRO_BENCHMARK_VALUES(KeyKind, MaxSize)                                 \
+  DRO_BENCHMARK_MATRIX(KeyKind, 0, MaxSize);                                   \
+  DRO_BENCHMARK_MATRIX(KeyKind, 8, MaxSize);                                   \
+  DRO_BENCHMARK_MATRIX(KeyKind, 64, MaxSize);                                  \
+  DRO_BENCHMARK_MATRIX(KeyKind, 256, MaxSize)
+
+// Key types and value sizes
+DRO_BENCHMARK_VALUES(Int32Key, uint32_t);
+DRO_BENCHMARK_VALUES(Int64Key, uint32_t);
+DRO_BENCHMARK_VALUES(Struct16Key, uint32_t);
+DRO_BENCHMARK_VALUES(ShortStringKey, uint32_t);
+DRO_BENCHMARK_VALUES(LongStringKey, uint32_t);
+
+// MaxSize widths
+DRO_BENCHMARK_VALUES(Int32Key, uint16_t);
+DRO_BENCHMARK_VALUES(Int32Key, uint64_t);
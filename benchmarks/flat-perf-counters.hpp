@@ -0,0 +1,175 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_FLAT_PERF_COUNTERS
+#define DRO_FLAT_PERF_COUNTERS
+
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define DRO_FLAT_PERF_EVENTS
+
+// Read misses of a PERF_TYPE_HW_CACHE cache
+constexpr std::uint64_t perfCacheMiss(std::uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+// Hardware counters of the benchmark thread through perf_event_open, user
+// space only so a perf_event_paranoid of 2 still allows them. Each event has
+// its own descriptor, the kernel multiplexes them when there are more events
+// than counters and the counts are scaled by the time each one ran.
+class PerfCounters {
+public:
+  constexpr static std::size_t events_ = 6;
+
+  PerfCounters() { fds_.fill(-1); }
+
+  PerfCounters(const PerfCounters&)            = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  ~PerfCounters() {
+#ifdef DRO_FLAT_PERF_EVENTS
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  // Opens the events the CPU and the kernel support, false if none
+  bool open() {
+#ifdef DRO_FLAT_PERF_EVENTS
+    for (std::size_t event {}; event < events_; ++event) {
+      perf_event_attr attr {};
+      attr.size           = sizeof(attr);
+      attr.type           = types_[event];
+      attr.config         = configs_[event];
+      attr.disabled       = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv     = 1;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[event] = static_cast<int>(
+          syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      enabled_ |= fds_[event] >= 0;
+    }
+#endif
+    return enabled_;
+  }
+
+  [[nodiscard]] bool enabled() const noexcept { return enabled_; }
+
+  // Zeroes and starts the counters at the top of the timed loop
+  void start() {
+    _control(Control::Reset);
+    _control(Control::Enable);
+  }
+
+  void pause() { _control(Control::Disable); }
+
+  void resume() { _control(Control::Enable); }
+
+  // Stops the counters and reports each count per operation
+  void report(benchmark::State& state, std::int64_t operations) {
+    if (! enabled_) {
+      return;
+    }
+    pause();
+    double total = static_cast<double>(state.iterations()) *
+                   static_cast<double>(operations);
+    for (std::size_t event {}; event < events_; ++event) {
+      double count {};
+      if (_read(event, count) && total > 0) {
+        state.counters[names_[event]] = count / total;
+      }
+    }
+  }
+
+private:
+  enum class Control { Reset, Enable, Disable };
+
+#ifdef DRO_FLAT_PERF_EVENTS
+  constexpr static std::array<std::uint32_t, events_> types_ {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+      PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+  constexpr static std::array<std::uint64_t, events_> configs_ {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      perfCacheMiss(PERF_COUNT_HW_CACHE_L1D),
+      perfCacheMiss(PERF_COUNT_HW_CACHE_LL),
+      perfCacheMiss(PERF_COUNT_HW_CACHE_DTLB),
+      PERF_COUNT_HW_BRANCH_MISSES};
+#endif
+  inline static const std::array<std::string, events_> names_ {
+      "cycles",     "instructions", "l1d_misses",
+      "llc_misses", "dtlb_misses",  "branch_misses"};
+
+  std::array<int, events_> fds_;
+  bool enabled_ {};
+
+#ifdef DRO_FLAT_PERF_EVENTS
+  void _control(Control control) {
+    if (! enabled_) {
+      return;
+    }
+    unsigned long request {};
+    switch (control) {
+    case Control::Reset:
+      request = PERF_EVENT_IOC_RESET;
+      break;
+    case Control::Enable:
+      request = PERF_EVENT_IOC_ENABLE;
+      break;
+    case Control::Disable:
+      request = PERF_EVENT_IOC_DISABLE;
+      break;
+    }
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, request, 0);
+      }
+    }
+  }
+
+  bool _read(std::size_t event, double& count) const {
+    // Value, time enabled, time running
+    std::array<std::uint64_t, 3> values {};
+    if (fds_[event] < 0 ||
+        ::read(fds_[event], values.data(), sizeof(values)) !=
+            static_cast<ssize_t>(sizeof(values)) ||
+        ! values[2]) {
+      return false;
+    }
+    count = static_cast<double>(values[0]) * static_cast<double>(values[1]) /
+            static_cast<double>(values[2]);
+    return true;
+  }
+#else
+  void _control(Control) {}
+
+  bool _read(std::size_t, double&) const { return false; }
+#endif
+};
+
+// Shared by every benchmark, opened by --perf_counters
+inline PerfCounters& perfCounters() {
+  static PerfCounters counters;
+  return counters;
+}
+
+#endif
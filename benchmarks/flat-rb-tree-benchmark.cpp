@@ -5,223 +5,139 @@
 // MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 // GNU General Public License for more details.
 
-#include <chrono> // for high_resolution_clock, nanoseconds
-#include <cstdint>// for uint32_t
+#include <benchmark/benchmark.h>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <map>
-#include <random>
+#include <sched.h>
+#include <string>
 #include <vector>
 
-#include "dro/flat-rb-tree.hpp"
-
-#if __has_include(<boost/container/flat_map.hpp> )
-#include <boost/container/flat_map.hpp>
-#endif
-
-#if __has_include(<folly/container/heap_vector_types.h> )
-#include <folly/container/heap_vector_types.h>
-#endif
-
-struct alignas(4) Test {
-  int x_;
-  Test() = default;
-  Test(int x) : x_(x) {}
-  auto operator<=>(const Test&) const = default;
-};
-
-int main() {
-  int iterations = 100'000;
-
-  // Generate Vector of Random Ints
-  std::vector<int> randInts(iterations);
-  std::vector<std::pair<Test, Test>> findKeys(iterations);
-  for (auto& i : randInts) { i = rand(); }
-
-  std::cout << "Dro FlatMap: \n";
-
-  // Insertion Benchmark
-  dro::FlatMap<Test, Test, uint32_t> dro_;
-  auto start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { dro_.emplace(Test(i), Test(i)); }
-  auto stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean insertion time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-  // Find Benchmark
-  int idx {};
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) {
-    findKeys[idx] = *(dro_.find(Test(i)));
-    ++idx;
+#include "flat-benchmark.hpp"
+
+// Inserts the random keys into an empty map, the destructor is not timed
+template <typename Map> void benchmarkInsert(benchmark::State& state) {
+  auto keys = randomKeys(static_cast<std::size_t>(state.range(0)));
+  startCounters();
+  for (auto _ : state) {
+    auto map = std::make_unique<Map>();
+    for (auto key : keys) { map->emplace(Test(key), Test(key)); }
+    benchmark::DoNotOptimize(map.get());
+    pauseTiming(state);
+    map.reset();
+    resumeTiming(state);
   }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean find time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-  // Remove Benchmark
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { dro_.erase(Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean erase time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-
-            << " ns.\n";
-
-  // ==============================================================================
-
-  std::cout << "STL Map: \n";
-
-  // Insertion Benchmark
-  std::map<Test, Test> stl_;
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { stl_.emplace(Test(i), Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean insertion time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
+  setOperations(state, state.range(0));
+}
 
-  // Find Benchmark
-  idx   = 0;
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) {
-    findKeys[idx] = *(stl_.find(Test(i)));
-    ++idx;
+// Finds every key in insertion order
+template <typename Map> void benchmarkFind(benchmark::State& state) {
+  auto keys = randomKeys(static_cast<std::size_t>(state.range(0)));
+  Map map;
+  for (auto key : keys) { map.emplace(Test(key), Test(key)); }
+  startCounters();
+  for (auto _ : state) {
+    for (auto key : keys) {
+      auto it = map.find(Test(key));
+      benchmark::DoNotOptimize(it);
+    }
   }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean find time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-  // Remove Benchmark
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { stl_.erase(Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean erase time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-#if __has_include(<boost/container/flat_map.hpp>)
-
-  std::cout << "Boost FlatMap: \n";
-
-  // Insertion Benchmark
-  boost::container::flat_map<Test, Test> boost_;
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { boost_.emplace(Test(i), Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean insertion time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
+  setOperations(state, state.range(0));
+}
 
-  // Find Benchmark
-  idx   = 0;
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) {
-    findKeys[idx] = *(boost_.find(Test(i)));
-    ++idx;
+// Erases every key of a full map, the refill is not timed
+template <typename Map> void benchmarkErase(benchmark::State& state) {
+  auto keys = randomKeys(static_cast<std::size_t>(state.range(0)));
+  startCounters();
+  for (auto _ : state) {
+    pauseTiming(state);
+    Map map;
+    for (auto key : keys) { map.emplace(Test(key), Test(key)); }
+    resumeTiming(state);
+    for (auto key : keys) { map.erase(Test(key)); }
+    benchmark::DoNotOptimize(map);
   }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean find time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-  // Remove Benchmark
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { boost_.erase(Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
+  setOperations(state, state.range(0));
+}
 
-  std::cout << "Mean erase time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
+// Read heavy workload of the balance policies, ten lookups per insert
+template <typename Map> void benchmarkReadHeavy(benchmark::State& state) {
+  constexpr int lookups = 10;
+  auto keys = randomKeys(static_cast<std::size_t>(state.range(0)));
+  startCounters();
+  for (auto _ : state) {
+    Map map;
+    for (auto key : keys) { map.emplace(Test(key), Test(key)); }
+    std::size_t found {};
+    for (int round {}; round < lookups; ++round) {
+      for (auto key : keys) { found += map.contains(Test(key)); }
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  setOperations(state, state.range(0) * (lookups + 1));
+}
 
-            << " ns.\n";
+#define DRO_BENCHMARK_MAP(Map)                                                 \
+  BENCHMARK_TEMPLATE(benchmarkInsert, Map)->Apply(benchmarkMapArgs<Map>);      \
+  BENCHMARK_TEMPLATE(benchmarkFind, Map)->Apply(benchmarkMapArgs<Map>);        \
+  BENCHMARK_TEMPLATE(benchmarkErase, Map)->Apply(benchmarkMapArgs<Map>)
 
+DRO_BENCHMARK_MAP(DroFlatMap);
+DRO_BENCHMARK_MAP(StdMap);
+#if __has_include(<boost/container/flat_map.hpp>)
+DRO_BENCHMARK_MAP(BoostFlatMap);
 #endif
-
 #if __has_include(<folly/container/heap_vector_types.h>)
-
-  std::cout << "Folly heap_vector_map: \n";
-
-  // Insertion Benchmark
-  folly::heap_vector_map<Test, Test> folly_;
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { folly_.emplace(Test(i), Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean insertion time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-  // Find Benchmark
-  idx   = 0;
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) {
-    findKeys[idx] = *(folly_.find(Test(i)));
-    ++idx;
-  }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean find time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-            << " ns.\n";
-
-  // Remove Benchmark
-  start = std::chrono::high_resolution_clock::now();
-  for (auto i : randInts) { folly_.erase(Test(i)); }
-  stop = std::chrono::high_resolution_clock::now();
-
-  std::cout << "Mean erase time: "
-            << std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
-                                                                    start)
-                       .count() /
-                   iterations
-
-            << " ns.\n";
-
+DRO_BENCHMARK_MAP(FollyHeapVectorMap);
 #endif
 
+// Balance Policies
+BENCHMARK_TEMPLATE(benchmarkReadHeavy, DroBalanceMap<dro::RedBlackBalance>)
+    ->Apply(benchmarkMapArgs<DroFlatMap>);
+BENCHMARK_TEMPLATE(benchmarkReadHeavy,
+                   DroBalanceMap<dro::TopDownRedBlackBalance>)
+    ->Apply(benchmarkMapArgs<DroFlatMap>);
+BENCHMARK_TEMPLATE(benchmarkReadHeavy, DroBalanceMap<dro::AVLBalance>)
+    ->Apply(benchmarkMapArgs<DroFlatMap>);
+BENCHMARK_TEMPLATE(benchmarkReadHeavy, DroBalanceMap<dro::WAVLBalance>)
+    ->Apply(benchmarkMapArgs<DroFlatMap>);
+
+// Defaults go first so the command line overrides them. --pin_cpu=N runs the
+// benchmarks on core N, best an isolated one. --perf_counters adds the
+// hardware counters per operation.
+int main(int argc, char** argv) {
+  std::vector<char*> args {argv[0]};
+  std::string repetitions = "--benchmark_repetitions=5";
+  std::string aggregates  = "--benchmark_report_aggregates_only=true";
+  std::string warmup      = "--benchmark_min_warmup_time=0.1";
+  std::string format      = "--benchmark_out_format=json";
+  args.insert(args.end(), {repetitions.data(), aggregates.data(),
+                           warmup.data(), format.data()});
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--pin_cpu=", 10) == 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(std::atoi(argv[i] + 10), &cpus);
+      if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+        std::cerr << "Cannot pin to " << argv[i] + 10 << '\n';
+        return 1;
+      }
+      continue;
+    }
+    if (std::strcmp(argv[i], "--perf_counters") == 0) {
+      if (! perfCounters().open()) {
+        std::cerr << "No perf counters, check perf_event_paranoid\n";
+      }
+      continue;
+    }
+    args.push_back(argv[i]);
+  }
+  int count = static_cast<int>(args.size());
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
   return 0;
 }
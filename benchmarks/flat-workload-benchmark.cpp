@@ -0,0 +1,88 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "flat-benchmark.hpp"
+#include "flat-workloads.hpp"
+
+template <typename Map>
+std::size_t replayWorkload(Map& map, const std::vector<WorkloadStep>& steps) {
+  std::size_t result {};
+  for (const auto& step : steps) {
+    switch (step.op_) {
+    case WorkloadOp::Find:
+      result += map.find(Test(step.key_)) != map.end();
+      break;
+    case WorkloadOp::Insert:
+      result += map.emplace(Test(step.key_), Test(step.key_)).second;
+      break;
+    case WorkloadOp::Erase:
+      result += map.erase(Test(step.key_));
+      break;
+    case WorkloadOp::Scan: {
+      auto it = map.lower_bound(Test(step.key_));
+      for (int i {}; i < step.length_ && it != map.end(); ++i, ++it) {
+        result += static_cast<std::size_t>(it->second.x_);
+      }
+      break;
+    }
+    }
+  }
+  return result;
+}
+
+// Replays the steps of a generated workload. A workload with writes starts
+// every iteration from a fresh map of the initial keys, the refill is not
+// timed.
+template <typename Map, Workload (*Generate)(std::size_t)>
+void benchmarkWorkload(benchmark::State& state) {
+  auto work = Generate(static_cast<std::size_t>(state.range(0)));
+  auto map  = std::make_unique<Map>();
+  for (int key : work.initial_) { map->emplace(Test(key), Test(key)); }
+  startCounters();
+  for (auto _ : state) {
+    if (! work.readOnly_) {
+      pauseTiming(state);
+      map = std::make_unique<Map>();
+      for (int key : work.initial_) { map->emplace(Test(key), Test(key)); }
+      resumeTiming(state);
+    }
+    benchmark::DoNotOptimize(replayWorkload(*map, work.steps_));
+  }
+  setOperations(state, static_cast<std::int64_t>(work.steps_.size()));
+}
+
+#define DRO_BENCHMARK_WORKLOAD(Map, Generate, Args)                            \
+  BENCHMARK_TEMPLATE(benchmarkWorkload, Map, Generate)->Apply(Args<Map>)
+
+#define DRO_BENCHMARK_WORKLOADS(Map)                                           \
+  DRO_BENCHMARK_WORKLOAD(Map, zipfLookups<>, benchmarkMapArgs);                \
+  DRO_BENCHMARK_WORKLOAD(Map, hotSetLookups<>, benchmarkMapArgs);              \
+  DRO_BENCHMARK_WORKLOAD(Map, missLookups<>, benchmarkMapArgs);                \
+  DRO_BENCHMARK_WORKLOAD(Map, rangeScans<10>, benchmarkMapArgs);               \
+  DRO_BENCHMARK_WORKLOAD(Map, rangeScans<100>, benchmarkMapArgs);              \
+  DRO_BENCHMARK_WORKLOAD(Map, rangeScans<1000>, benchmarkMapArgs);             \
+  DRO_BENCHMARK_WORKLOAD(Map, sortedInserts<>, benchmarkWriteArgs);            \
+  DRO_BENCHMARK_WORKLOAD(Map, sortedInserts<16>, benchmarkWriteArgs);          \
+  DRO_BENCHMARK_WORKLOAD(Map, mixedReadWrite<95>, benchmarkWriteArgs);         \
+  DRO_BENCHMARK_WORKLOAD(Map, mixedReadWrite<50>, benchmarkWriteArgs);         \
+  DRO_BENCHMARK_WORKLOAD(Map, slidingWindow, benchmarkWriteArgs);              \
+  DRO_BENCHMARK_WORKLOAD(Map, orderBook, benchmarkWriteArgs)
+
+DRO_BENCHMARK_WORKLOADS(DroFlatMap);
+DRO_BENCHMARK_WORKLOADS(StdMap);
+#if __has_include(<boost/container/flat_map.hpp>)
+DRO_BENCHMARK_WORKLOADS(BoostFlatMap);
+#endif
+#if __has_include(<folly/container/heap_vector_types.h>)
+DRO_BENCHMARK_WORKLOADS(FollyHeapVectorMap);
+#endif
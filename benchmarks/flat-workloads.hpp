@@ -0,0 +1,198 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_FLAT_WORKLOADS
+#define DRO_FLAT_WORKLOADS
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Workloads are generated before the timed region, a benchmark replays the
+// steps against a map filled with the initial keys
+
+enum class WorkloadOp : std::uint8_t { Find, Insert, Erase, Scan };
+
+struct WorkloadStep {
+  WorkloadOp op_ {};
+  int key_ {};
+  int length_ {};
+};
+
+struct Workload {
+  std::vector<int> initial_;
+  std::vector<WorkloadStep> steps_;
+  // Lookups only, the map is filled once for every iteration
+  bool readOnly_ {};
+};
+
+// Enough steps per iteration that refilling the map stays a small part of a
+// run of the small sizes
+inline std::size_t workloadSteps(std::size_t size) {
+  return std::max<std::size_t>(size, 10'000);
+}
+
+// Distinct even keys in random order, odd keys are never inserted
+inline std::vector<int> workloadKeys(std::size_t size, std::mt19937_64& gen) {
+  std::vector<int> keys(size);
+  std::iota(keys.begin(), keys.end(), 0);
+  for (auto& key : keys) { key *= 2; }
+  std::shuffle(keys.begin(), keys.end(), gen);
+  return keys;
+}
+
+// Lookups of Zipf distributed ranks, rank one the most frequent. The ranks
+// map to random keys, so the hot keys are spread over the tree.
+template <int SkewPercent = 99> Workload zipfLookups(std::size_t size) {
+  std::mt19937_64 gen(1);
+  Workload work {workloadKeys(size, gen), {}, true};
+  std::vector<double> cdf(size);
+  double sum {};
+  for (std::size_t rank {}; rank < size; ++rank) {
+    sum       += 1.0 / std::pow(static_cast<double>(rank + 1),
+                                SkewPercent / 100.0);
+    cdf[rank]  = sum;
+  }
+  std::uniform_real_distribution<double> dist(0, sum);
+  for (std::size_t step {}; step < workloadSteps(size); ++step) {
+    auto rank = static_cast<std::size_t>(
+        std::lower_bound(cdf.begin(), cdf.end(), dist(gen)) - cdf.begin());
+    work.steps_.push_back(
+        {WorkloadOp::Find, work.initial_[std::min(rank, size - 1)], 0});
+  }
+  return work;
+}
+
+// HotPercent of the lookups go to one percent of the keys
+template <int HotPercent = 90> Workload hotSetLookups(std::size_t size) {
+  std::mt19937_64 gen(2);
+  Workload work {workloadKeys(size, gen), {}, true};
+  std::size_t hot = std::max<std::size_t>(size / 100, 1);
+  std::uniform_int_distribution<std::size_t> hotDist(0, hot - 1);
+  std::uniform_int_distribution<std::size_t> allDist(0, size - 1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  for (std::size_t step {}; step < workloadSteps(size); ++step) {
+    std::size_t index = (percent(gen) < HotPercent) ? hotDist(gen)
+                                                    : allDist(gen);
+    work.steps_.push_back({WorkloadOp::Find, work.initial_[index], 0});
+  }
+  return work;
+}
+
+// MissPercent of the lookups search for an absent key
+template <int MissPercent = 90> Workload missLookups(std::size_t size) {
+  std::mt19937_64 gen(3);
+  Workload work {workloadKeys(size, gen), {}, true};
+  std::uniform_int_distribution<std::size_t> dist(0, size - 1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  for (std::size_t step {}; step < workloadSteps(size); ++step) {
+    int key = work.initial_[dist(gen)];
+    key    += (percent(gen) < MissPercent) ? 1 : 0;
+    work.steps_.push_back({WorkloadOp::Find, key, 0});
+  }
+  return work;
+}
+
+// Ascending inserts into an empty map. With a displacement each key moves
+// up to that many places from its sorted position.
+template <int Displacement = 0> Workload sortedInserts(std::size_t size) {
+  std::mt19937_64 gen(4);
+  Workload work;
+  std::vector<int> keys(size);
+  std::iota(keys.begin(), keys.end(), 0);
+  if constexpr (Displacement > 0) {
+    for (std::size_t index {}; index + 1 < size; ++index) {
+      std::uniform_int_distribution<std::size_t> dist(
+          index, std::min(size - 1, index + Displacement));
+      std::swap(keys[index], keys[dist(gen)]);
+    }
+  }
+  for (int key : keys) { work.steps_.push_back({WorkloadOp::Insert, key, 0}); }
+  return work;
+}
+
+// Lookups with ReadPercent, the writes alternate an insert of an absent key
+// and an erase of a present one so the size stays about the same
+template <int ReadPercent> Workload mixedReadWrite(std::size_t size) {
+  std::mt19937_64 gen(5);
+  Workload work {workloadKeys(size, gen), {}, false};
+  std::uniform_int_distribution<std::size_t> dist(0, size - 1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  bool insert = true;
+  for (std::size_t step {}; step < workloadSteps(size); ++step) {
+    int key = work.initial_[dist(gen)];
+    if (percent(gen) < ReadPercent) {
+      work.steps_.push_back({WorkloadOp::Find, key, 0});
+    } else if (insert) {
+      work.steps_.push_back({WorkloadOp::Insert, key + 1, 0});
+      insert = false;
+    } else {
+      work.steps_.push_back({WorkloadOp::Erase, key, 0});
+      insert = true;
+    }
+  }
+  return work;
+}
+
+// Time ordered keys in a window of size, every insert of a new key erases
+// the oldest one
+inline Workload slidingWindow(std::size_t size) {
+  Workload work;
+  work.initial_.resize(size);
+  std::iota(work.initial_.begin(), work.initial_.end(), 0);
+  for (std::size_t step {}; step < workloadSteps(size); ++step) {
+    work.steps_.push_back(
+        {WorkloadOp::Insert, static_cast<int>(size + step), 0});
+    work.steps_.push_back({WorkloadOp::Erase, static_cast<int>(step), 0});
+  }
+  return work;
+}
+
+// Scans of Length elements from a random key
+template <int Length> Workload rangeScans(std::size_t size) {
+  std::mt19937_64 gen(6);
+  Workload work {workloadKeys(size, gen), {}, true};
+  std::uniform_int_distribution<int> dist(0, static_cast<int>(size) * 2);
+  // The same number of elements visited whatever the length
+  std::size_t scans = std::max<std::size_t>(workloadSteps(size) / Length, 1);
+  for (std::size_t step {}; step < scans; ++step) {
+    work.steps_.push_back({WorkloadOp::Scan, dist(gen), Length});
+  }
+  return work;
+}
+
+// Bid side of an order book, the best bid is the largest key. Half the steps
+// update a level a geometric distance below the best, the rest improve the
+// best with a new level or clear the best level.
+inline Workload orderBook(std::size_t size) {
+  std::mt19937_64 gen(7);
+  Workload work;
+  int best = static_cast<int>(size) * 2;
+  for (std::size_t level {}; level < size; ++level) {
+    work.initial_.push_back(best - static_cast<int>(level));
+  }
+  std::geometric_distribution<int> depth(0.3);
+  std::uniform_int_distribution<int> percent(0, 99);
+  for (std::size_t step {}; step < workloadSteps(size); ++step) {
+    int roll = percent(gen);
+    if (roll < 50) {
+      work.steps_.push_back({WorkloadOp::Find, best - depth(gen), 0});
+    } else if (roll < 75) {
+      work.steps_.push_back({WorkloadOp::Insert, ++best, 0});
+    } else {
+      work.steps_.push_back({WorkloadOp::Erase, best--, 0});
+    }
+  }
+  return work;
+}
+
+#endif
@@ -0,0 +1,89 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Heat map of node depth against array position from a dump_layout CSV.
+//   flat-layout-heat-map layout.csv
+// Without a file, dumps a map after random inserts and erases instead. A heap
+// ordered array fills a diagonal band, churn spreads the nodes of every depth
+// across the whole array.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <dro/flat-rb-tree.hpp>// for dro::FlatMap
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  std::stringstream csv;
+  if (argc > 1) {
+    std::ifstream file(argv[1]);
+    if (! file) {
+      std::cerr << "Cannot open " << argv[1] << '\n';
+      return 1;
+    }
+    csv << file.rdbuf();
+  } else {
+    dro::FlatMap<int, int> map;
+    for (int i {}; i < 200'000; ++i) {
+      int key = rand() % 100'000;
+      if (rand() % 3) {
+        map[key] = i;
+      } else {
+        map.erase(key);
+      }
+    }
+    map.dump_layout(csv);
+  }
+
+  // Index and depth of every row, the header names the columns
+  std::string line;
+  std::getline(csv, line);
+  std::vector<std::pair<std::size_t, std::size_t>> nodes;
+  std::size_t maxDepth {};
+  while (std::getline(csv, line)) {
+    std::stringstream row(line);
+    std::string field;
+    std::vector<std::string> fields;
+    while (std::getline(row, field, ',')) { fields.push_back(field); }
+    if (fields.size() < 7) {
+      continue;
+    }
+    std::size_t depth = std::stoull(fields[6]);
+    nodes.emplace_back(std::stoull(fields[0]), depth);
+    maxDepth = std::max(maxDepth, depth);
+  }
+  if (nodes.empty()) {
+    std::cout << "Empty tree\n";
+    return 0;
+  }
+
+  // Rows are depths, columns are equal slices of the array
+  constexpr std::size_t columns = 64;
+  const std::string shades      = " .:-=+*#%@";
+  std::vector<std::vector<std::size_t>> cells(
+      maxDepth + 1, std::vector<std::size_t>(columns));
+  std::size_t peak {};
+  for (auto [index, depth] : nodes) {
+    auto& cell = cells[depth][index * columns / nodes.size()];
+    peak       = std::max(peak, ++cell);
+  }
+  std::cout << "depth | array position 0 .. " << nodes.size() - 1 << '\n';
+  for (std::size_t depth {}; depth <= maxDepth; ++depth) {
+    std::cout.width(5);
+    std::cout << depth << " |";
+    for (std::size_t count : cells[depth]) {
+      std::size_t shade = count ? 1 + count * (shades.size() - 2) / peak : 0;
+      std::cout << shades[shade];
+    }
+    std::cout << "|\n";
+  }
+  return 0;
+}
@@ -0,0 +1,311 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_ELIAS_FANO_SET
+#define DRO_ELIAS_FANO_SET
+
+#include <algorithm>// for sort, is_sorted, unique
+#include <bit>      // for popcount, countr_zero, bit_width
+#include <concepts> // for unsigned_integral
+#include <cstddef>  // for size_t, ptrdiff_t
+#include <cstdint>  // for uint64_t
+#include <iterator> // for forward_iterator_tag
+#include <vector>   // for vector
+
+namespace dro {
+
+// Documentation:
+// EliasFanoSet<Key>
+// Read only set of unsigned integers in Elias-Fano encoding, about
+// 2 + log2(universe / size) bits per element. Keys are split into low bits,
+// stored packed, and high bits, stored in unary in a bit vector. Skip
+// pointers every 256 ones and zeros make access and lower_bound constant
+// time on average.
+// Key: Unsigned integral type
+
+template <std::unsigned_integral Key> class EliasFanoSet {
+public:
+  using key_type   = Key;
+  using value_type = Key;
+  using size_type  = std::size_t;
+
+  class const_iterator {
+  public:
+    using value_type        = Key;
+    using difference_type   = std::ptrdiff_t;
+    using reference         = Key;
+    using pointer           = void;
+    using iterator_category = std::forward_iterator_tag;
+
+    const_iterator() = default;
+
+    const_iterator(const EliasFanoSet* set, std::size_t index, std::size_t bit)
+        : set_(set), index_(index), bit_(bit) {}
+
+    bool operator==(const const_iterator& other) const {
+      return other.set_ == set_ && other.index_ == index_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return ! (*this == other);
+    }
+
+    const_iterator& operator++() {
+      ++index_;
+      if (index_ < set_->size_) {
+        bit_ = set_->_nextOne(bit_ + 1);
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator copy = *this;
+      ++(*this);
+      return copy;
+    }
+
+    Key operator*() const { return set_->_value(index_, bit_); }
+
+  private:
+    const EliasFanoSet* set_ = nullptr;
+    std::size_t index_ {};
+    std::size_t bit_ {};
+  };
+
+private:
+  constexpr static std::size_t sample_rate_ = 256;
+  constexpr static std::size_t word_bits_   = 64;
+
+  std::vector<std::uint64_t> upper_;
+  std::vector<std::uint64_t> lower_;
+  // Bit position of every sample_rate_ one and zero in upper_
+  std::vector<std::size_t> onesSamples_;
+  std::vector<std::size_t> zerosSamples_;
+  std::size_t size_ {};
+  std::size_t lowBits_ {};
+  std::uint64_t span_ {};
+  Key min_ {};
+
+  friend const_iterator;
+
+public:
+  EliasFanoSet() = default;
+
+  // Builds from any container of keys, e.g. dro::FlatSet
+  template <typename Container> explicit EliasFanoSet(const Container& keys) {
+    std::vector<Key> sorted(keys.begin(), keys.end());
+    if (! std::is_sorted(sorted.begin(), sorted.end())) {
+      std::sort(sorted.begin(), sorted.end());
+    }
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    _build(sorted);
+  }
+
+  // Iterators
+  [[nodiscard]] const_iterator begin() const {
+    return size_ ? const_iterator(this, 0, _nextOne(0)) : end();
+  }
+
+  [[nodiscard]] const_iterator end() const {
+    return const_iterator(this, size_, 0);
+  }
+
+  // Capacity
+  [[nodiscard]] size_type size() const noexcept { return size_; }
+
+  [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+  [[nodiscard]] size_type bytes() const noexcept {
+    return (upper_.size() + lower_.size()) * sizeof(std::uint64_t) +
+           (onesSamples_.size() + zerosSamples_.size()) * sizeof(std::size_t);
+  }
+
+  // Lookup
+  [[nodiscard]] Key at(size_type index) const {
+    return _value(index, _select1(index));
+  }
+
+  [[nodiscard]] bool contains(const key_type& key) const {
+    auto iter = lower_bound(key);
+    return iter != end() && *iter == key;
+  }
+
+  [[nodiscard]] size_type count(const key_type& key) const {
+    return contains(key);
+  }
+
+  [[nodiscard]] const_iterator lower_bound(const key_type& key) const {
+    if (! size_ || key <= min_) {
+      return begin();
+    }
+    std::uint64_t value = static_cast<std::uint64_t>(key - min_);
+    if (value > span_) {
+      return end();
+    }
+    std::uint64_t high = value >> lowBits_;
+    std::uint64_t low  = value & _lowMask();
+    // The bucket of high starts after the high-th zero
+    std::size_t bit   = high ? _select0(high - 1) + 1 : 0;
+    std::size_t index = bit - high;
+    for (; _testBit(bit); ++bit, ++index) {
+      if (_low(index) >= low) {
+        return const_iterator(this, index, bit);
+      }
+    }
+    return (index < size_) ? const_iterator(this, index, _nextOne(bit)) : end();
+  }
+
+  [[nodiscard]] const_iterator upper_bound(const key_type& key) const {
+    auto iter = lower_bound(key);
+    if (iter != end() && *iter == key) {
+      ++iter;
+    }
+    return iter;
+  }
+
+  // Keys contained in both sets, in ascending order
+  [[nodiscard]] std::vector<Key> intersection(const EliasFanoSet& other) const {
+    const EliasFanoSet& small = (size_ <= other.size_) ? *this : other;
+    const EliasFanoSet& large = (size_ <= other.size_) ? other : *this;
+    std::vector<Key> result;
+    auto largeEnd = large.end();
+    for (Key key : small) {
+      auto iter = large.lower_bound(key);
+      if (iter == largeEnd) {
+        break;
+      }
+      if (*iter == key) {
+        result.push_back(key);
+      }
+    }
+    return result;
+  }
+
+private:
+  void _build(const std::vector<Key>& keys) {
+    size_ = keys.size();
+    if (! size_) {
+      return;
+    }
+    min_  = keys.front();
+    span_ = static_cast<std::uint64_t>(keys.back() - min_);
+    // Floor of log2(span / size) low bits per element
+    std::uint64_t ratio = span_ / size_;
+    lowBits_              = ratio ? std::bit_width(ratio) - 1 : 0;
+    std::size_t upperBits = size_ + (span_ >> lowBits_) + 1;
+    upper_.assign(upperBits / word_bits_ + 1, 0);
+    lower_.assign((size_ * lowBits_) / word_bits_ + 1, 0);
+    for (std::size_t i {}; i < size_; ++i) {
+      std::uint64_t value = static_cast<std::uint64_t>(keys[i] - min_);
+      std::size_t bit     = (value >> lowBits_) + i;
+      upper_[bit / word_bits_] |= std::uint64_t {1} << (bit % word_bits_);
+      _setLow(i, value & _lowMask());
+    }
+    std::size_t ones {};
+    std::size_t zeros {};
+    for (std::size_t bit {}; bit < upperBits; ++bit) {
+      if (_testBit(bit)) {
+        if (ones % sample_rate_ == 0) {
+          onesSamples_.push_back(bit);
+        }
+        ++ones;
+      } else {
+        if (zeros % sample_rate_ == 0) {
+          zerosSamples_.push_back(bit);
+        }
+        ++zeros;
+      }
+    }
+  }
+
+  [[nodiscard]] std::uint64_t _lowMask() const {
+    return lowBits_ ? (~std::uint64_t {} >> (word_bits_ - lowBits_)) : 0;
+  }
+
+  [[nodiscard]] bool _testBit(std::size_t bit) const {
+    return (upper_[bit / word_bits_] >> (bit % word_bits_)) & 1;
+  }
+
+  void _setLow(std::size_t index, std::uint64_t low) {
+    if (! lowBits_) {
+      return;
+    }
+    std::size_t bit   = index * lowBits_;
+    std::size_t word  = bit / word_bits_;
+    std::size_t shift = bit % word_bits_;
+    lower_[word] |= low << shift;
+    if (shift + lowBits_ > word_bits_) {
+      lower_[word + 1] |= low >> (word_bits_ - shift);
+    }
+  }
+
+  [[nodiscard]] std::uint64_t _low(std::size_t index) const {
+    if (! lowBits_) {
+      return 0;
+    }
+    std::size_t bit     = index * lowBits_;
+    std::size_t word    = bit / word_bits_;
+    std::size_t shift   = bit % word_bits_;
+    std::uint64_t value = lower_[word] >> shift;
+    if (shift + lowBits_ > word_bits_) {
+      value |= lower_[word + 1] << (word_bits_ - shift);
+    }
+    return value & _lowMask();
+  }
+
+  [[nodiscard]] Key _value(std::size_t index, std::size_t bit) const {
+    std::uint64_t high = bit - index;
+    return static_cast<Key>(
+        min_ + static_cast<Key>((high << lowBits_) | _low(index)));
+  }
+
+  [[nodiscard]] std::size_t _nextOne(std::size_t bit) const {
+    std::size_t word    = bit / word_bits_;
+    std::uint64_t value = upper_[word];
+    value &= ~std::uint64_t {} << (bit % word_bits_);
+    while (! value) { value = upper_[++word]; }
+    return word * word_bits_ +
+           static_cast<std::size_t>(std::countr_zero(value));
+  }
+
+  // Position of the rank-th set bit of value
+  static std::size_t _selectInWord(std::uint64_t value, std::size_t rank) {
+    for (; rank; --rank) { value &= value - 1; }
+    return static_cast<std::size_t>(std::countr_zero(value));
+  }
+
+  // Position of the rank-th one, or zero if Ones is false
+  template <bool Ones>
+  [[nodiscard]] std::size_t _select(const std::vector<std::size_t>& samples,
+                                    std::size_t rank) const {
+    std::size_t bit       = samples[rank / sample_rate_];
+    std::size_t remaining = rank % sample_rate_;
+    std::size_t word      = bit / word_bits_;
+    std::uint64_t value   = Ones ? upper_[word] : ~upper_[word];
+    value &= ~std::uint64_t {} << (bit % word_bits_);
+    while (true) {
+      auto count = static_cast<std::size_t>(std::popcount(value));
+      if (remaining < count) {
+        return word * word_bits_ + _selectInWord(value, remaining);
+      }
+      remaining -= count;
+      ++word;
+      value = Ones ? upper_[word] : ~upper_[word];
+    }
+  }
+
+  [[nodiscard]] std::size_t _select1(std::size_t rank) const {
+    return _select<true>(onesSamples_, rank);
+  }
+
+  [[nodiscard]] std::size_t _select0(std::size_t rank) const {
+    return _select<false>(zerosSamples_, rank);
+  }
+};
+
+}// namespace dro
+#endif
@@ -0,0 +1,311 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_FLAT_EXTERNAL_BUILD
+#define DRO_FLAT_EXTERNAL_BUILD
+
+#include <algorithm>  // for stable_sort, unique, max
+#include <bit>        // for bit_width
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint8_t
+#include <cstdio>     // for FILE, tmpfile, fopen, fread, fwrite
+#include <iterator>   // for input_iterator
+#include <limits>     // for numeric_limits
+#include <memory>     // for unique_ptr
+#include <queue>      // for priority_queue
+#include <stdexcept>  // for runtime_error
+#include <string>     // for string
+#include <type_traits>// for is_same_v, is_trivially_copyable_v
+#include <unistd.h>   // for fsync
+#include <utility>    // for move
+#include <vector>     // for vector
+
+#include "dro/flat-rb-tree.hpp"
+
+namespace dro {
+namespace details {
+
+struct ExternalFileClose {
+  void operator()(std::FILE* file) const noexcept { std::fclose(file); }
+};
+
+using ExternalFile = std::unique_ptr<std::FILE, ExternalFileClose>;
+
+inline void externalWrite(std::FILE* file, const void* data,
+                          std::size_t bytes) {
+  if (bytes && std::fwrite(data, 1, bytes, file) != bytes) {
+    throw std::runtime_error("dro::build_external");
+  }
+}
+
+// Sorted run spilled to a temporary file, read back a block at a time
+template <typename Pair> class ExternalRun {
+  ExternalFile file_;
+  std::vector<Pair> block_;
+  std::size_t pos_ {};
+  std::size_t count_ {};
+
+public:
+  ExternalRun(ExternalFile file, std::size_t blockElements)
+      : file_(std::move(file)), block_(blockElements) {
+    std::rewind(file_.get());
+    _fill();
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return pos_ == count_; }
+
+  [[nodiscard]] const Pair& front() const noexcept { return block_[pos_]; }
+
+  void pop() {
+    if (++pos_ == count_) {
+      _fill();
+    }
+  }
+
+private:
+  void _fill() {
+    pos_   = 0;
+    count_ = std::fread(block_.data(), sizeof(Pair), block_.size(),
+                        file_.get());
+    if (std::ferror(file_.get())) {
+      throw std::runtime_error("dro::build_external");
+    }
+  }
+};
+
+// Slot index of the sorted input is its slot in the tree. The tree is the
+// perfectly balanced one over [0, size), each subtree roots at the middle of
+// its range, so every level above the deepest is full.
+template <typename Node>
+void externalNode(Node& node, std::size_t index, std::size_t size) {
+  using index_type = decltype(Node::left_);
+  constexpr auto empty_index = std::numeric_limits<index_type>::max();
+  std::size_t low {};
+  std::size_t high   = size;
+  std::size_t parent = empty_index;
+  std::size_t depth {};
+  std::size_t middle = size / 2;
+  while (middle != index) {
+    parent = middle;
+    if (index < middle) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+    middle = low + (high - low) / 2;
+    ++depth;
+  }
+  node.left_  = (low < middle)
+                    ? static_cast<index_type>(low + (middle - low) / 2)
+                    : empty_index;
+  node.right_ = (middle + 1 < high)
+                    ? static_cast<index_type>(
+                          middle + 1 + (high - middle - 1) / 2)
+                    : empty_index;
+  if constexpr (requires { node.parent_; }) {
+    node.parent_ = static_cast<index_type>(parent);
+  }
+  if constexpr (requires { node.color_; }) {
+    // Black above the deepest level, red on a partly filled deepest level
+    auto fullDepth = static_cast<std::size_t>(std::bit_width(size + 1)) - 1;
+    node.color_    = depth < fullDepth;
+  } else {
+    // Rank is the height of the subtree
+    node.rank_ = static_cast<std::uint8_t>(std::bit_width(high - low) - 1);
+  }
+}
+
+// K-way merge of sorted runs into a new run, the earlier run wins a duplicate
+// key. Count is the number of merged elements.
+template <typename Pair>
+ExternalFile externalMerge(std::vector<ExternalFile>& files,
+                           std::size_t memoryElements, const auto& less,
+                           const auto& same, std::size_t& count) {
+  std::size_t blockElements =
+      std::max<std::size_t>(memoryElements / (files.size() + 1), 64);
+  std::vector<ExternalRun<Pair>> runs;
+  runs.reserve(files.size());
+  for (auto& file : files) {
+    runs.emplace_back(std::move(file), blockElements);
+  }
+  auto later = [&runs, &less](std::size_t lhs, std::size_t rhs) {
+    if (less(runs[rhs].front(), runs[lhs].front())) {
+      return true;
+    }
+    return ! less(runs[lhs].front(), runs[rhs].front()) && lhs > rhs;
+  };
+  std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)>
+      heap(later);
+  for (std::size_t index {}; index < runs.size(); ++index) {
+    if (! runs[index].empty()) {
+      heap.push(index);
+    }
+  }
+  ExternalFile merged(std::tmpfile());
+  if (! merged) {
+    throw std::runtime_error("dro::build_external");
+  }
+  std::vector<Pair> block;
+  block.reserve(blockElements);
+  count = 0;
+  while (! heap.empty()) {
+    std::size_t index = heap.top();
+    heap.pop();
+    const Pair& elem = runs[index].front();
+    if (block.empty() || ! same(block.back(), elem)) {
+      if (block.size() == blockElements) {
+        externalWrite(merged.get(), block.data(), block.size() * sizeof(Pair));
+        block.clear();
+      }
+      block.push_back(elem);
+      ++count;
+    }
+    runs[index].pop();
+    if (! runs[index].empty()) {
+      heap.push(index);
+    }
+  }
+  externalWrite(merged.get(), block.data(), block.size() * sizeof(Pair));
+  return merged;
+}
+
+}// namespace details
+
+// Documentation:
+// build_external<Map>(first, last, path, runElements)
+// Map: dro::FlatMap or dro::FlatSet with dro::CheckpointStorage, trivially
+//      copyable keys and values
+// first, last: Unsorted input, pairs for a map and keys for a set. The first
+//              value of a duplicate key is kept, as with insert.
+// path: Output file, loaded with Map::recover
+// runElements: Elements sorted in memory at a time, default 2^20
+//
+// Sorts runs of the input into temporary files, merges them 64 at a time and
+// streams the node array of a balanced tree into a checkpoint at path. Memory
+// use is about one run and one chunk of nodes, whatever the size of the input.
+
+template <typename Map, std::input_iterator InputIt>
+void build_external(InputIt first, InputIt last, const std::string& path,
+                    std::size_t runElements = std::size_t {1} << 20) {
+  using key_type    = typename Map::key_type;
+  using mapped_type = typename Map::mapped_type;
+  using value_type  = typename Map::value_type;
+  using node_type   = typename Map::node_type;
+  using record_type = details::FlatTreeCheckpointRecord;
+  static_assert(requires { Map::storage_type::chunk_; },
+                "The output is a checkpoint, use dro::CheckpointStorage");
+  static_assert(std::is_trivially_copyable_v<key_type> &&
+                    std::is_trivially_copyable_v<mapped_type>,
+                "Runs and checkpoints copy the node bytes");
+  constexpr std::size_t chunkNodes = Map::storage_type::chunk_;
+  constexpr std::size_t fanIn      = 64;
+  constexpr std::size_t maxSize =
+      std::numeric_limits<decltype(node_type::left_)>::max();
+  typename Map::key_compare compare;
+  auto less = [&compare](const value_type& lhs, const value_type& rhs) {
+    return compare(lhs.first, rhs.first);
+  };
+  auto same = [](const value_type& lhs, const value_type& rhs) {
+    return lhs.first == rhs.first;
+  };
+
+  // Sorted runs without duplicate keys, the stable sort keeps the first
+  runElements = std::max<std::size_t>(runElements, 1);
+  std::vector<std::vector<details::ExternalFile>> levels(1);
+  std::vector<value_type> run;
+  run.reserve(runElements);
+  auto spill = [&]() {
+    std::stable_sort(run.begin(), run.end(), less);
+    run.erase(std::unique(run.begin(), run.end(), same), run.end());
+    details::ExternalFile file(std::tmpfile());
+    if (! file) {
+      throw std::runtime_error("dro::build_external");
+    }
+    details::externalWrite(file.get(), run.data(),
+                           run.size() * sizeof(value_type));
+    levels[0].push_back(std::move(file));
+    run.clear();
+    // Bounds the open files, a full level merges into the next
+    for (std::size_t level {}; levels[level].size() == fanIn; ++level) {
+      if (level + 1 == levels.size()) {
+        levels.emplace_back();
+      }
+      std::size_t count {};
+      levels[level + 1].push_back(details::externalMerge<value_type>(
+          levels[level], runElements, less, same, count));
+      levels[level].clear();
+    }
+  };
+  for (; first != last; ++first) {
+    if constexpr (std::is_same_v<mapped_type, details::FlatSetEmptyType>) {
+      run.push_back(value_type {key_type(*first), {}});
+    } else {
+      run.push_back(value_type(*first));
+    }
+    if (run.size() == runElements) {
+      spill();
+    }
+  }
+  if (! run.empty()) {
+    spill();
+  }
+  std::vector<value_type>().swap(run);
+
+  // Whatever is left, oldest level first
+  std::vector<details::ExternalFile> files;
+  for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+    for (auto& file : *level) { files.push_back(std::move(file)); }
+  }
+  levels.clear();
+  std::size_t size {};
+  details::ExternalFile merged = details::externalMerge<value_type>(
+      files, runElements, less, same, size);
+  if (size >= maxSize) {
+    throw std::runtime_error("Size exceeds max capacity of size type. "
+                             "Increase size type of tree.");
+  }
+
+  // Streams the node array one chunk at a time, then commits the manifest
+  details::ExternalFile output(std::fopen(path.c_str(), "wb"));
+  if (! output) {
+    throw std::runtime_error("dro::build_external");
+  }
+  details::ExternalRun<value_type> sorted(std::move(merged), chunkNodes);
+  std::vector<node_type> chunk;
+  chunk.reserve(chunkNodes);
+  record_type record;
+  record.nodeBytes_  = sizeof(node_type);
+  record.chunkNodes_ = chunkNodes;
+  record.kind_       = record_type::chunk_;
+  for (std::size_t index {}; index < size; ++index) {
+    node_type node {};
+    node.pair_ = sorted.front();
+    sorted.pop();
+    details::externalNode(node, index, size);
+    chunk.push_back(node);
+    if (chunk.size() == chunkNodes || index + 1 == size) {
+      record.index_ = index / chunkNodes;
+      record.count_ = chunk.size();
+      details::externalWrite(output.get(), &record, sizeof(record));
+      details::externalWrite(output.get(), chunk.data(),
+                             chunk.size() * sizeof(node_type));
+      chunk.clear();
+    }
+  }
+  record.kind_  = record_type::manifest_;
+  record.index_ = size;
+  record.count_ = size ? size / 2 : maxSize;
+  record.first_ = size ? 0 : maxSize;
+  record.last_  = size ? size - 1 : maxSize;
+  details::externalWrite(output.get(), &record, sizeof(record));
+  if (std::fflush(output.get()) != 0 || ::fsync(fileno(output.get())) != 0) {
+    throw std::runtime_error("dro::build_external");
+  }
+}
+
+}// namespace dro
+#endif
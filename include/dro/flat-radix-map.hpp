@@ -0,0 +1,747 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_FLAT_RADIX_MAP
+#define DRO_FLAT_RADIX_MAP
+
+#include <bit>        // for countl_zero
+#include <concepts>   // for integral
+#include <cstddef>    // for size_t, ptrdiff_t
+#include <cstdint>    // for uint8_t, uint16_t
+#include <iterator>   // for forward_iterator_tag
+#include <limits>     // for numeric_limits
+#include <stdexcept>  // for out_of_range, runtime_error
+#include <type_traits>// for make_unsigned, is_signed
+#include <utility>    // for pair, forward
+#include <vector>     // for vector
+
+#include "dro/flat-rb-tree.hpp"
+
+namespace dro {
+namespace details {
+
+template <typename T>
+concept RadixKey = std::integral<T> && ! std::is_same_v<T, bool>;
+
+// Inner node with up to Capacity sorted children, used for sizes 4 and 16
+template <typename Bits, Integral MaxSize, std::size_t Capacity>
+struct RadixNodeSorted {
+  constexpr static std::size_t capacity_ = Capacity;
+
+  Bits prefix_ {};
+  std::uint8_t depth_ {};
+  std::uint16_t count_ {};
+  std::uint8_t keys_[Capacity] {};
+  MaxSize children_[Capacity] {};
+
+  MaxSize* find(std::uint8_t byte) {
+    for (std::uint16_t i {}; i < count_; ++i) {
+      if (keys_[i] == byte) {
+        return &children_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // First child with a byte not less than byte
+  MaxSize next(std::size_t byte, std::size_t& found) const {
+    for (std::uint16_t i {}; i < count_; ++i) {
+      if (keys_[i] >= byte) {
+        found = keys_[i];
+        return children_[i];
+      }
+    }
+    return 0;
+  }
+
+  void add(std::uint8_t byte, MaxSize child) {
+    std::uint16_t pos = count_;
+    for (; pos > 0 && keys_[pos - 1] > byte; --pos) {
+      keys_[pos]     = keys_[pos - 1];
+      children_[pos] = children_[pos - 1];
+    }
+    keys_[pos]     = byte;
+    children_[pos] = child;
+    ++count_;
+  }
+
+  void remove(std::uint8_t byte) {
+    std::uint16_t pos {};
+    while (keys_[pos] != byte) { ++pos; }
+    for (--count_; pos < count_; ++pos) {
+      keys_[pos]     = keys_[pos + 1];
+      children_[pos] = children_[pos + 1];
+    }
+  }
+};
+
+template <typename Bits, Integral MaxSize> struct RadixNode48 {
+  constexpr static std::size_t capacity_ = 48;
+
+  Bits prefix_ {};
+  std::uint8_t depth_ {};
+  std::uint16_t count_ {};
+  // Slot + 1 of the child for every byte, zero if empty
+  std::uint8_t index_[256] {};
+  MaxSize children_[capacity_] {};
+
+  MaxSize* find(std::uint8_t byte) {
+    return index_[byte] ? &children_[index_[byte] - 1] : nullptr;
+  }
+
+  MaxSize next(std::size_t byte, std::size_t& found) const {
+    for (; byte < 256; ++byte) {
+      if (index_[byte]) {
+        found = byte;
+        return children_[index_[byte] - 1];
+      }
+    }
+    return 0;
+  }
+
+  void add(std::uint8_t byte, MaxSize child) {
+    std::uint8_t slot {};
+    while (children_[slot]) { ++slot; }
+    children_[slot] = child;
+    index_[byte]    = static_cast<std::uint8_t>(slot + 1);
+    ++count_;
+  }
+
+  void remove(std::uint8_t byte) {
+    children_[index_[byte] - 1] = 0;
+    index_[byte]                = 0;
+    --count_;
+  }
+};
+
+template <typename Bits, Integral MaxSize> struct RadixNode256 {
+  constexpr static std::size_t capacity_ = 256;
+
+  Bits prefix_ {};
+  std::uint8_t depth_ {};
+  std::uint16_t count_ {};
+  MaxSize children_[capacity_] {};
+
+  MaxSize* find(std::uint8_t byte) {
+    return children_[byte] ? &children_[byte] : nullptr;
+  }
+
+  MaxSize next(std::size_t byte, std::size_t& found) const {
+    for (; byte < 256; ++byte) {
+      if (children_[byte]) {
+        found = byte;
+        return children_[byte];
+      }
+    }
+    return 0;
+  }
+
+  void add(std::uint8_t byte, MaxSize child) {
+    children_[byte] = child;
+    ++count_;
+  }
+
+  void remove(std::uint8_t byte) {
+    children_[byte] = 0;
+    --count_;
+  }
+};
+
+template <typename Pair> struct RadixLeaf {
+  Pair pair_;
+};
+
+// Nodes of one type in a vector, erased slots are reused
+template <typename Node, Integral MaxSize> struct RadixPool {
+  std::vector<Node> nodes_;
+  std::vector<MaxSize> free_;
+
+  std::size_t allocate() {
+    if (! free_.empty()) {
+      std::size_t index = free_.back();
+      free_.pop_back();
+      nodes_[index] = Node();
+      return index;
+    }
+    nodes_.emplace_back();
+    return nodes_.size() - 1;
+  }
+
+  void release(std::size_t index) {
+    free_.push_back(static_cast<MaxSize>(index));
+  }
+
+  void clear() noexcept {
+    nodes_.clear();
+    free_.clear();
+  }
+};
+
+template <typename Container> struct FlatRadixIterator {
+  using key_type          = typename Container::key_type;
+  using value_type        = typename Container::value_type;
+  using size_type         = typename Container::size_type;
+  using difference_type   = std::ptrdiff_t;
+  using reference         = std::conditional_t<std::is_const_v<Container>,
+                                               const value_type&, value_type&>;
+  using pointer           = std::conditional_t<std::is_const_v<Container>,
+                                               const value_type*, value_type*>;
+  using iterator_category = std::forward_iterator_tag;
+
+  explicit FlatRadixIterator(Container* radixMap, size_type index)
+      : radixMap_(radixMap), index_(index) {}
+
+  bool operator==(const FlatRadixIterator& other) const {
+    return other.radixMap_ == radixMap_ && other.index_ == index_;
+  }
+  bool operator!=(const FlatRadixIterator& other) const {
+    return ! (*this == other);
+  }
+
+  FlatRadixIterator& operator++() {
+    index_ = radixMap_->_next(index_);
+    return *this;
+  }
+
+  reference operator*() const {
+    return radixMap_->leaves_.nodes_[index_].pair_;
+  }
+
+  pointer operator->() const {
+    return &radixMap_->leaves_.nodes_[index_].pair_;
+  }
+
+private:
+  Container* radixMap_ = nullptr;
+  size_type index_ {};
+  friend Container;
+};
+
+}// namespace details
+
+// Documentation:
+// FlatRadixMap<Key, Value, MaxSize>
+// Adaptive radix tree for integral keys, one byte per level with inner nodes
+// of 4, 16, 48 and 256 children and path compression. Every node type is
+// stored in its own vector and linked by index, lookups cost at most
+// sizeof(Key) levels independent of the size of the map.
+// Key: Integral type
+// Value: Must be default constructible and a copyable or moveable type
+// MaxSize: Integral type used for node indexes, three bits are reserved for
+//          the node type
+
+template <details::RadixKey Key, details::FlatTree_Type Value,
+          details::Integral MaxSize = std::size_t>
+class FlatRadixMap {
+public:
+  using key_type        = Key;
+  using mapped_type     = Value;
+  using value_type      = std::pair<Key, Value>;
+  using size_type       = MaxSize;
+  using difference_type = std::ptrdiff_t;
+  using self_type       = FlatRadixMap<Key, Value, MaxSize>;
+  using iterator        = details::FlatRadixIterator<self_type>;
+  using const_iterator  = details::FlatRadixIterator<const self_type>;
+
+private:
+  using bits_type = std::make_unsigned_t<Key>;
+  using node4     = details::RadixNodeSorted<bits_type, MaxSize, 4>;
+  using node16    = details::RadixNodeSorted<bits_type, MaxSize, 16>;
+  using node48    = details::RadixNode48<bits_type, MaxSize>;
+  using node256   = details::RadixNode256<bits_type, MaxSize>;
+  using leaf_type = details::RadixLeaf<value_type>;
+
+  // Child references pack the node type in the low bits, zero is empty
+  constexpr static std::size_t empty_ref_   = 0;
+  constexpr static std::size_t leaf_ref_    = 1;
+  constexpr static std::size_t node4_ref_   = 2;
+  constexpr static std::size_t node16_ref_  = 3;
+  constexpr static std::size_t node48_ref_  = 4;
+  constexpr static std::size_t node256_ref_ = 5;
+  constexpr static std::size_t type_bits_   = 3;
+  constexpr static std::size_t type_mask_   = (1 << type_bits_) - 1;
+  constexpr static std::size_t key_length_  = sizeof(Key);
+  constexpr static size_type empty_index_ =
+      std::numeric_limits<size_type>::max();
+
+  details::RadixPool<node4, MaxSize> node4s_;
+  details::RadixPool<node16, MaxSize> node16s_;
+  details::RadixPool<node48, MaxSize> node48s_;
+  details::RadixPool<node256, MaxSize> node256s_;
+  details::RadixPool<leaf_type, MaxSize> leaves_;
+  MaxSize root_ {};
+  size_type size_ {};
+
+  friend iterator;
+  friend const_iterator;
+
+public:
+  FlatRadixMap() = default;
+
+  // Element Access
+  mapped_type& at(const key_type& key) {
+    size_type index = _findIndex(key);
+    if (index == empty_index_) {
+      throw std::out_of_range("dro::FlatRadixMap::at");
+    }
+    return leaves_.nodes_[index].pair_.second;
+  }
+
+  const mapped_type& at(const key_type& key) const {
+    size_type index = _findIndex(key);
+    if (index == empty_index_) {
+      throw std::out_of_range("dro::FlatRadixMap::at");
+    }
+    return leaves_.nodes_[index].pair_.second;
+  }
+
+  mapped_type& operator[](const key_type& key) {
+    size_type index = _emplace(key).first.index_;
+    return leaves_.nodes_[index].pair_.second;
+  }
+
+  // Iterators
+  iterator begin() { return iterator(this, _minimum(root_)); }
+
+  const_iterator begin() const { return const_iterator(this, _minimum(root_)); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  iterator end() { return iterator(this, empty_index_); }
+
+  const_iterator end() const { return const_iterator(this, empty_index_); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  // Capacity
+  [[nodiscard]] size_type size() const noexcept { return size_; }
+
+  [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+  [[nodiscard]] size_type max_size() const noexcept {
+    return empty_index_ >> type_bits_;
+  }
+
+  void reserve(size_type new_cap) { leaves_.nodes_.reserve(new_cap); }
+
+  // Modifiers
+  void clear() noexcept {
+    node4s_.clear();
+    node16s_.clear();
+    node48s_.clear();
+    node256s_.clear();
+    leaves_.clear();
+    root_ = empty_ref_;
+    size_ = 0;
+  }
+
+  std::pair<iterator, bool> insert(const value_type& pair) {
+    return _emplace(pair.first, pair.second);
+  }
+
+  std::pair<iterator, bool> insert(value_type&& pair) {
+    return _emplace(pair.first, std::move(pair.second));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const key_type& key, Args&&... args) {
+    return _emplace(key, std::forward<Args>(args)...);
+  }
+
+  iterator erase(iterator pos) {
+    if (pos == end()) {
+      return end();
+    }
+    size_type next = _next(pos.index_);
+    _erase(leaves_.nodes_[pos.index_].pair_.first);
+    return iterator(this, next);
+  }
+
+  size_type erase(const key_type& key) { return _erase(key); }
+
+  // Lookup
+  [[nodiscard]] size_type count(const key_type& key) const {
+    return contains(key);
+  }
+
+  [[nodiscard]] iterator find(const key_type& key) {
+    return iterator(this, _findIndex(key));
+  }
+
+  [[nodiscard]] const_iterator find(const key_type& key) const {
+    return const_iterator(this, _findIndex(key));
+  }
+
+  [[nodiscard]] bool contains(const key_type& key) const {
+    return _findIndex(key) != empty_index_;
+  }
+
+  [[nodiscard]] iterator lower_bound(const key_type& key) {
+    return iterator(this, _lowerBound(root_, _toBits(key)));
+  }
+
+  [[nodiscard]] const_iterator lower_bound(const key_type& key) const {
+    return const_iterator(this, _lowerBound(root_, _toBits(key)));
+  }
+
+  [[nodiscard]] iterator upper_bound(const key_type& key) {
+    return iterator(this, _upperBound(key));
+  }
+
+  [[nodiscard]] const_iterator upper_bound(const key_type& key) const {
+    return const_iterator(this, _upperBound(key));
+  }
+
+private:
+  // Order preserving unsigned representation, flips the sign bit
+  static bits_type _toBits(const key_type& key) {
+    auto bits = static_cast<bits_type>(key);
+    if constexpr (std::is_signed_v<Key>) {
+      bits ^= static_cast<bits_type>(bits_type {1} << (key_length_ * 8 - 1));
+    }
+    return bits;
+  }
+
+  static std::uint8_t _byte(bits_type bits, std::size_t depth) {
+    return static_cast<std::uint8_t>(bits >> ((key_length_ - 1 - depth) * 8));
+  }
+
+  // Index of the first byte that differs, key_length_ if equal
+  static std::size_t _mismatch(bits_type lhs, bits_type rhs) {
+    bits_type diff = lhs ^ rhs;
+    if (! diff) {
+      return key_length_;
+    }
+    return static_cast<std::size_t>(std::countl_zero(diff)) / 8;
+  }
+
+  static std::size_t _type(MaxSize ref) { return ref & type_mask_; }
+
+  static std::size_t _index(MaxSize ref) { return ref >> type_bits_; }
+
+  static MaxSize _makeRef(std::size_t index, std::size_t type) {
+    if (index > (empty_index_ >> type_bits_) - 1) {
+      throw std::runtime_error("Size exceeds max capacity of size type. "
+                               "Increase size type of radix map.");
+    }
+    return static_cast<MaxSize>((index << type_bits_) | type);
+  }
+
+  // Calls func with the inner node behind ref
+  template <typename Func> decltype(auto) _visit(MaxSize ref, Func&& func) {
+    std::size_t index = _index(ref);
+    switch (_type(ref)) {
+    case node4_ref_:
+      return func(node4s_.nodes_[index]);
+    case node16_ref_:
+      return func(node16s_.nodes_[index]);
+    case node48_ref_:
+      return func(node48s_.nodes_[index]);
+    default:
+      return func(node256s_.nodes_[index]);
+    }
+  }
+
+  template <typename Func>
+  decltype(auto) _visit(MaxSize ref, Func&& func) const {
+    return const_cast<self_type*>(this)->_visit(ref, std::forward<Func>(func));
+  }
+
+  template <typename... Args>
+  MaxSize _newLeaf(const key_type& key, Args&&... args) {
+    std::size_t index      = leaves_.allocate();
+    auto& leaf             = leaves_.nodes_[index];
+    leaf.pair_.first       = key;
+    leaf.pair_.second      = mapped_type(std::forward<Args>(args)...);
+    return _makeRef(index, leaf_ref_);
+  }
+
+  // New node4 at depth holding two children that differ at depth
+  MaxSize _newBranch(bits_type prefix, std::size_t depth, MaxSize childA,
+                     bits_type bitsA, MaxSize childB, bits_type bitsB) {
+    std::size_t index = node4s_.allocate();
+    auto& node        = node4s_.nodes_[index];
+    node.prefix_      = prefix;
+    node.depth_       = static_cast<std::uint8_t>(depth);
+    node.add(_byte(bitsA, depth), childA);
+    node.add(_byte(bitsB, depth), childB);
+    return _makeRef(index, node4_ref_);
+  }
+
+  void _setChild(MaxSize parent, std::uint8_t byte, MaxSize child) {
+    if (parent == empty_ref_) {
+      root_ = child;
+      return;
+    }
+    _visit(parent, [&](auto& node) { *node.find(byte) = child; });
+  }
+
+  // Moves every child of ref into a new node of type To
+  template <typename To>
+  MaxSize _convert(MaxSize ref, auto& pool, std::size_t type) {
+    std::size_t index = pool.allocate();
+    _visit(ref, [&](auto& from) {
+      To& to      = pool.nodes_[index];
+      to.prefix_  = from.prefix_;
+      to.depth_   = from.depth_;
+      std::size_t byte {};
+      for (MaxSize child = from.next(0, byte); child;
+           child         = from.next(byte + 1, byte)) {
+        to.add(static_cast<std::uint8_t>(byte), child);
+      }
+    });
+    _release(ref);
+    return _makeRef(index, type);
+  }
+
+  void _release(MaxSize ref) {
+    std::size_t index = _index(ref);
+    switch (_type(ref)) {
+    case leaf_ref_:
+      leaves_.release(index);
+      break;
+    case node4_ref_:
+      node4s_.release(index);
+      break;
+    case node16_ref_:
+      node16s_.release(index);
+      break;
+    case node48_ref_:
+      node48s_.release(index);
+      break;
+    default:
+      node256s_.release(index);
+    }
+  }
+
+  // Returns the reference of the node, which changes if the node grew
+  MaxSize _addChild(MaxSize ref, std::uint8_t byte, MaxSize child) {
+    bool full = _visit(ref, [](auto& node) {
+      return node.count_ == std::remove_cvref_t<decltype(node)>::capacity_;
+    });
+    if (full) {
+      switch (_type(ref)) {
+      case node4_ref_:
+        ref = _convert<node16>(ref, node16s_, node16_ref_);
+        break;
+      case node16_ref_:
+        ref = _convert<node48>(ref, node48s_, node48_ref_);
+        break;
+      default:
+        ref = _convert<node256>(ref, node256s_, node256_ref_);
+      }
+    }
+    _visit(ref, [&](auto& node) { node.add(byte, child); });
+    return ref;
+  }
+
+  // Returns the reference that replaces the node, which changes if the node
+  // shrank or was left with a single child
+  MaxSize _removeChild(MaxSize ref, std::uint8_t byte) {
+    std::size_t count = _visit(ref, [&](auto& node) {
+      node.remove(byte);
+      return static_cast<std::size_t>(node.count_);
+    });
+    switch (_type(ref)) {
+    case node4_ref_:
+      if (count == 1) {
+        // Path compression, children keep their absolute depth
+        std::size_t found {};
+        MaxSize child = node4s_.nodes_[_index(ref)].next(0, found);
+        _release(ref);
+        return child;
+      }
+      break;
+    case node16_ref_:
+      if (count < 3) {
+        return _convert<node4>(ref, node4s_, node4_ref_);
+      }
+      break;
+    case node48_ref_:
+      if (count < 12) {
+        return _convert<node16>(ref, node16s_, node16_ref_);
+      }
+      break;
+    default:
+      if (count < 36) {
+        return _convert<node48>(ref, node48s_, node48_ref_);
+      }
+    }
+    return ref;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> _emplace(const key_type& key, Args&&... args) {
+    bits_type bits = _toBits(key);
+    if (root_ == empty_ref_) {
+      root_ = _newLeaf(key, std::forward<Args>(args)...);
+      ++size_;
+      return {iterator(this, static_cast<size_type>(_index(root_))), true};
+    }
+    MaxSize parent = empty_ref_;
+    std::uint8_t parentByte {};
+    MaxSize ref  = root_;
+    MaxSize leaf = empty_ref_;
+    while (true) {
+      if (_type(ref) == leaf_ref_) {
+        bits_type leafBits = _toBits(leaves_.nodes_[_index(ref)].pair_.first);
+        if (leafBits == bits) {
+          return {iterator(this, static_cast<size_type>(_index(ref))), false};
+        }
+        leaf = _newLeaf(key, std::forward<Args>(args)...);
+        _setChild(parent, parentByte,
+                  _newBranch(bits, _mismatch(bits, leafBits), ref, leafBits,
+                             leaf, bits));
+        break;
+      }
+      auto [prefix, depth] = _visit(ref, [](auto& node) {
+        return std::pair<bits_type, std::size_t>(node.prefix_, node.depth_);
+      });
+      std::size_t mismatch = _mismatch(bits, prefix);
+      if (mismatch < depth) {
+        // Key leaves the compressed path above this node
+        leaf = _newLeaf(key, std::forward<Args>(args)...);
+        _setChild(parent, parentByte,
+                  _newBranch(bits, mismatch, ref, prefix, leaf, bits));
+        break;
+      }
+      std::uint8_t byte = _byte(bits, depth);
+      MaxSize child     = _visit(ref, [&](auto& node) {
+        MaxSize* slot = node.find(byte);
+        return slot ? *slot : MaxSize {};
+      });
+      if (child == empty_ref_) {
+        leaf          = _newLeaf(key, std::forward<Args>(args)...);
+        MaxSize grown = _addChild(ref, byte, leaf);
+        if (grown != ref) {
+          _setChild(parent, parentByte, grown);
+        }
+        break;
+      }
+      parent     = ref;
+      parentByte = byte;
+      ref        = child;
+    }
+    ++size_;
+    return {iterator(this, static_cast<size_type>(_index(leaf))), true};
+  }
+
+  size_type _erase(const key_type& key) {
+    bits_type bits = _toBits(key);
+    MaxSize grandparent = empty_ref_;
+    MaxSize parent      = empty_ref_;
+    std::uint8_t grandparentByte {};
+    std::uint8_t parentByte {};
+    MaxSize ref = root_;
+    while (ref != empty_ref_ && _type(ref) != leaf_ref_) {
+      std::uint8_t byte = _byte(bits, _visit(ref, [](auto& node) {
+                                  return static_cast<std::size_t>(node.depth_);
+                                }));
+      grandparent     = parent;
+      grandparentByte = parentByte;
+      parent          = ref;
+      parentByte      = byte;
+      ref             = _visit(ref, [&](auto& node) {
+        MaxSize* slot = node.find(byte);
+        return slot ? *slot : MaxSize {};
+      });
+    }
+    if (ref == empty_ref_ || leaves_.nodes_[_index(ref)].pair_.first != key) {
+      return 0;
+    }
+    _release(ref);
+    --size_;
+    if (parent == empty_ref_) {
+      root_ = empty_ref_;
+      return 1;
+    }
+    MaxSize replacement = _removeChild(parent, parentByte);
+    if (replacement != parent) {
+      _setChild(grandparent, grandparentByte, replacement);
+    }
+    return 1;
+  }
+
+  size_type _findIndex(const key_type& key) const {
+    bits_type bits = _toBits(key);
+    MaxSize ref    = root_;
+    // Prefixes are checked once at the leaf
+    while (ref != empty_ref_ && _type(ref) != leaf_ref_) {
+      ref = _visit(ref, [&](auto& node) {
+        MaxSize* slot = node.find(_byte(bits, node.depth_));
+        return slot ? *slot : MaxSize {};
+      });
+    }
+    if (ref == empty_ref_ || leaves_.nodes_[_index(ref)].pair_.first != key) {
+      return empty_index_;
+    }
+    return static_cast<size_type>(_index(ref));
+  }
+
+  size_type _minimum(MaxSize ref) const {
+    if (ref == empty_ref_) {
+      return empty_index_;
+    }
+    while (_type(ref) != leaf_ref_) {
+      ref = _visit(ref, [](auto& node) {
+        std::size_t found {};
+        return node.next(0, found);
+      });
+    }
+    return static_cast<size_type>(_index(ref));
+  }
+
+  size_type _lowerBound(MaxSize ref, bits_type bits) const {
+    if (ref == empty_ref_) {
+      return empty_index_;
+    }
+    if (_type(ref) == leaf_ref_) {
+      bits_type leafBits = _toBits(leaves_.nodes_[_index(ref)].pair_.first);
+      return (leafBits >= bits) ? static_cast<size_type>(_index(ref))
+                                : empty_index_;
+    }
+    auto [prefix, depth] = _visit(ref, [](auto& node) {
+      return std::pair<bits_type, std::size_t>(node.prefix_, node.depth_);
+    });
+    std::size_t mismatch = _mismatch(bits, prefix);
+    if (mismatch < depth) {
+      return (_byte(bits, mismatch) < _byte(prefix, mismatch)) ? _minimum(ref)
+                                                               : empty_index_;
+    }
+    std::size_t byte = _byte(bits, depth);
+    std::size_t found {};
+    MaxSize child =
+        _visit(ref, [&](auto& node) { return node.next(byte, found); });
+    if (child == empty_ref_) {
+      return empty_index_;
+    }
+    if (found == byte) {
+      size_type index = _lowerBound(child, bits);
+      if (index != empty_index_) {
+        return index;
+      }
+      child = _visit(ref,
+                     [&](auto& node) { return node.next(byte + 1, found); });
+    }
+    return _minimum(child);
+  }
+
+  size_type _upperBound(const key_type& key) const {
+    bits_type bits = _toBits(key);
+    if (bits == std::numeric_limits<bits_type>::max()) {
+      return empty_index_;
+    }
+    return _lowerBound(root_, static_cast<bits_type>(bits + 1));
+  }
+
+  size_type _next(size_type index) const {
+    return _upperBound(leaves_.nodes_[index].pair_.first);
+  }
+};
+
+}// namespace dro
+#endif
@@ -8,18 +8,128 @@
 #ifndef DRO_FLAT_RED_BLACK_TREE
 #define DRO_FLAT_RED_BLACK_TREE
 
+#include <algorithm>       // for max
+#include <array>           // for array
+#include <bit>             // for bit_width
+#include <chrono>          // for steady_clock
+#include <climits>         // for CHAR_BIT
+#include <cerrno>          // for errno, EINTR
 #include <concepts>        // for requires
 #include <cstddef>         // for size_t, ptrdiff_t
+#include <cstdint>         // for uint32_t, uint64_t
+#include <cstring>         // for memcpy
 #include <functional>      // for less
+#include <future>          // for async, future
 #include <initializer_list>// for initializer_list
 #include <iterator>        // for pair, bidirectional_iterator_tag
 #include <limits>          // for numeric_limits
+#include <ostream>         // for ostream
+#include <span>            // for span
 #include <stdexcept>       // for out_of_range, runtime_error
+#include <string>          // for basic_string
 #include <type_traits>     // for std::is_default_constructible
+#include <unistd.h>        // for write, pread, fsync, ftruncate
 #include <utility>         // for pair, forward
 #include <vector>          // for vector, allocator
+#if defined(__GLIBC__) && __has_include(<malloc.h>)
+#include <malloc.h>        // for malloc_usable_size
+#endif
+
+// Static tracepoints of the provider dro for perf and bpftrace, compiled in by
+// defining DRO_FLAT_RB_TREE_USDT where <sys/sdt.h> exists
+#if defined(DRO_FLAT_RB_TREE_USDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define DRO_FLAT_PROBE(name, ...) STAP_PROBEV(dro, name, __VA_ARGS__)
+#define DRO_FLAT_PROBE_COUNTS
+#else
+#define DRO_FLAT_PROBE(name, ...) static_cast<void>(0)
+#endif
 
 namespace dro {
+
+// Lookup policies, see FlatMap documentation below
+struct NoLookupIndex {};
+
+template <typename Hash = void> struct HashLookupIndex {};
+
+template <typename Hash = void> struct BloomLookupFilter {};
+
+// Balance policies, see FlatMap documentation below
+struct RedBlackBalance {};
+
+struct TopDownRedBlackBalance {};
+
+struct AVLBalance {};
+
+struct WAVLBalance {};
+
+// Erase policies, see FlatMap documentation below
+struct EagerErase {};
+
+template <std::size_t Percent = 25> struct LazyErase {};
+
+// Merkle policies, see FlatMap documentation below
+struct NoMerkleHash {};
+
+template <typename Hash = void> struct MerkleHash {};
+
+// Storage policies, see FlatMap documentation below
+struct VectorStorage {};
+
+template <std::size_t ChunkNodes = 4096> struct CheckpointStorage {};
+
+// Top cache policies, see FlatMap documentation below
+struct NoTopCache {};
+
+template <std::size_t Levels = 10> struct TopKeyCache {};
+
+// Stats policies, see FlatMap documentation below
+struct NoStats {};
+
+struct OperationStats {};
+
+struct PhaseStats {};
+
+// Savepoint policies, see FlatMap documentation below
+struct NoSavepoints {};
+
+struct UndoSavepoints {};
+
+// Output formats of dump_layout
+enum class LayoutFormat : std::uint8_t { CSV, DOT };
+
+// Heap bytes owned by a key or value, counted by memory_usage. Specialize for
+// other types that own heap memory.
+template <typename T> struct HeapBytes {
+  constexpr static bool owns_ = false;
+
+  std::size_t operator()(const T&) const noexcept { return 0; }
+};
+
+template <typename Char, typename Traits, typename Alloc>
+struct HeapBytes<std::basic_string<Char, Traits, Alloc>> {
+  constexpr static bool owns_ = true;
+
+  // A short string is stored inside the object
+  std::size_t
+  operator()(const std::basic_string<Char, Traits, Alloc>& str) const noexcept {
+    const auto* begin = reinterpret_cast<const char*>(&str);
+    const auto* data  = reinterpret_cast<const char*>(str.data());
+    if (data >= begin && data < begin + sizeof(str)) {
+      return 0;
+    }
+    return (str.capacity() + 1) * sizeof(Char);
+  }
+};
+
+template <typename T, typename Alloc> struct HeapBytes<std::vector<T, Alloc>> {
+  constexpr static bool owns_ = true;
+
+  std::size_t operator()(const std::vector<T, Alloc>& vec) const noexcept {
+    return vec.capacity() * sizeof(T);
+  }
+};
+
 namespace details {
 
 template <typename T>
@@ -43,7 +153,8 @@ template <FlatTree_Type Key> struct FlatSetPair {
   FlatSetEmptyType second [[no_unique_address]];
 };
 
-template <typename Pair, Integral MaxSize = std::size_t> struct Node {
+template <typename Pair, Integral MaxSize = std::size_t, bool Parent = true>
+struct Node {
   Pair pair_;
   MaxSize parent_ {};
   MaxSize left_ {};
@@ -51,6 +162,934 @@ template <typename Pair, Integral MaxSize = std::size_t> struct Node {
   bool color_ {};
 };
 
+// Top down balancing never walks up the tree, no parent index
+template <typename Pair, Integral MaxSize> struct Node<Pair, MaxSize, false> {
+  Pair pair_;
+  MaxSize left_ {};
+  MaxSize right_ {};
+  bool color_ {};
+};
+
+// AVL and weak AVL store a rank instead of a color, the path from the root
+// is kept on a stack during insert and erase
+template <typename Pair, Integral MaxSize = std::size_t> struct RankNode {
+  Pair pair_;
+  MaxSize left_ {};
+  MaxSize right_ {};
+  std::uint8_t rank_ {};
+};
+
+// Lookup policy interface. The tree calls insert with the nodes [0, size)
+// live, including the new node, so a policy can rebuild itself from the tree.
+struct FlatTreeNoIndex {
+  constexpr static bool exact_  = false;
+  constexpr static bool filter_ = false;
+
+  void insert(const auto&, auto, const auto&, auto) noexcept {}
+  void relocate(const auto&, auto, auto) noexcept {}
+  void swap(const auto&, auto, const auto&, auto) noexcept {}
+  void erase(const auto&, auto) noexcept {}
+  void reserve(auto, const auto&, auto) noexcept {}
+  void clear() noexcept {}
+
+  // Heap bytes held by the policy, counted by memory_usage
+  [[nodiscard]] std::size_t bytes() const noexcept { return 0; }
+};
+
+// Open addressing hash table from key to node index. Only the index and a
+// 32 bit hash are stored, the key is read from the tree on a hash match.
+// Entries are found by their node index for maintenance, so the table never
+// has to read the tree while the tree is mid rotation.
+template <typename Key, Integral MaxSize, typename Hash>
+class FlatTreeHashIndex {
+  constexpr static MaxSize empty_index_ = std::numeric_limits<MaxSize>::max();
+
+  struct Slot {
+    MaxSize index_ = empty_index_;
+    std::uint32_t hash_ {};
+  };
+
+  std::vector<Slot> slots_;
+  std::size_t mask_ {};
+  std::size_t size_ {};
+
+public:
+  constexpr static bool exact_  = true;
+  constexpr static bool filter_ = false;
+
+  template <typename Tree>
+  [[nodiscard]] MaxSize find(const Key& key, const Tree& tree) const {
+    if (slots_.empty()) {
+      return empty_index_;
+    }
+    std::uint32_t hash = _hash(key);
+    std::size_t pos    = hash & mask_;
+    while (true) {
+      const Slot& slot = slots_[pos];
+      if (slot.index_ == empty_index_) {
+        return empty_index_;
+      }
+      if (slot.hash_ == hash && tree[slot.index_].pair_.first == key) {
+        return slot.index_;
+      }
+      pos = (pos + 1) & mask_;
+    }
+  }
+
+  void insert(const Key& key, MaxSize index, const auto&, auto) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+      _rehash(slots_.empty() ? 16 : slots_.size() * 2);
+    }
+    std::uint32_t hash = _hash(key);
+    _place(hash, index);
+    ++size_;
+  }
+
+  void relocate(const Key& key, MaxSize from, MaxSize to) {
+    slots_[_slotOf(key, from)].index_ = to;
+  }
+
+  void swap(const Key& keyA, MaxSize indexA, const Key& keyB, MaxSize indexB) {
+    // Both slots must be found before either is written
+    std::size_t slotA     = _slotOf(keyA, indexA);
+    std::size_t slotB     = _slotOf(keyB, indexB);
+    slots_[slotA].index_ = indexB;
+    slots_[slotB].index_ = indexA;
+  }
+
+  void erase(const Key& key, MaxSize index) {
+    std::size_t hole = _slotOf(key, index);
+    std::size_t pos  = hole;
+    // Backward shift deletion, keeps probe chains free of tombstones
+    while (true) {
+      pos              = (pos + 1) & mask_;
+      const Slot& slot = slots_[pos];
+      if (slot.index_ == empty_index_) {
+        break;
+      }
+      std::size_t home = slot.hash_ & mask_;
+      if (((pos - home) & mask_) >= ((pos - hole) & mask_)) {
+        slots_[hole] = slot;
+        hole         = pos;
+      }
+    }
+    slots_[hole].index_ = empty_index_;
+    --size_;
+  }
+
+  void reserve(std::size_t count, const auto&, auto) {
+    std::size_t capacity = slots_.empty() ? 16 : slots_.size();
+    while (capacity < count * 2) { capacity *= 2; }
+    if (capacity > slots_.size()) {
+      _rehash(capacity);
+    }
+  }
+
+  void clear() noexcept {
+    for (auto& slot : slots_) { slot.index_ = empty_index_; }
+    size_ = 0;
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    return slots_.capacity() * sizeof(Slot);
+  }
+
+private:
+  static std::uint32_t _hash(const Key& key) {
+    // Fibonacci mixing, std::hash is the identity for integers
+    std::uint64_t hash = static_cast<std::uint64_t>(Hash()(key));
+    return static_cast<std::uint32_t>((hash * 0x9E3779B97F4A7C15ULL) >> 32);
+  }
+
+  std::size_t _slotOf(const Key& key, MaxSize index) const {
+    std::size_t pos = _hash(key) & mask_;
+    while (slots_[pos].index_ != index) { pos = (pos + 1) & mask_; }
+    return pos;
+  }
+
+  void _place(std::uint32_t hash, MaxSize index) {
+    std::size_t pos = hash & mask_;
+    while (slots_[pos].index_ != empty_index_) { pos = (pos + 1) & mask_; }
+    slots_[pos] = {index, hash};
+  }
+
+  void _rehash(std::size_t capacity) {
+    std::vector<Slot> oldSlots(capacity);
+    oldSlots.swap(slots_);
+    mask_ = capacity - 1;
+    for (const auto& slot : oldSlots) {
+      if (slot.index_ != empty_index_) {
+        _place(slot.hash_, slot.index_);
+      }
+    }
+  }
+};
+
+// Counting bloom filter in front of the binary search. All counters of a key
+// live in one cache line sized block, so a miss costs a single cache line.
+// Counters saturate and are never decremented after saturating. The filter
+// is rebuilt from the tree nodes when the number of keys doubles.
+template <typename Key, Integral MaxSize, typename Hash>
+class FlatTreeBloomFilter {
+  constexpr static std::size_t counters_per_key_ = 8;
+  constexpr static std::size_t block_size_       = 64;
+  constexpr static std::size_t hashes_           = 4;
+
+  struct alignas(block_size_) Block {
+    std::uint8_t counters_[block_size_] {};
+  };
+
+  std::vector<Block> blocks_;
+  std::size_t mask_ {};
+  std::size_t capacity_ {};
+  std::size_t size_ {};
+
+public:
+  constexpr static bool exact_  = false;
+  constexpr static bool filter_ = true;
+
+  [[nodiscard]] bool mayContain(const Key& key) const {
+    if (blocks_.empty()) {
+      return false;
+    }
+    std::uint64_t hash  = _hash(key);
+    const Block& block = blocks_[(hash >> 32) & mask_];
+    for (std::size_t i {}; i < hashes_; ++i) {
+      if (! block.counters_[(hash >> (i * 6)) & (block_size_ - 1)]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void insert(const Key& key, MaxSize, const auto& tree, auto size) {
+    if (size_ + 1 > capacity_) {
+      _rebuild(tree, static_cast<std::size_t>(size));
+      return;
+    }
+    _add(key);
+    ++size_;
+  }
+
+  void relocate(const Key&, MaxSize, MaxSize) noexcept {}
+
+  void swap(const Key&, MaxSize, const Key&, MaxSize) noexcept {}
+
+  void erase(const Key& key, MaxSize) {
+    std::uint64_t hash = _hash(key);
+    Block& block       = blocks_[(hash >> 32) & mask_];
+    for (std::size_t i {}; i < hashes_; ++i) {
+      auto& counter = block.counters_[(hash >> (i * 6)) & (block_size_ - 1)];
+      if (counter != std::numeric_limits<std::uint8_t>::max()) {
+        --counter;
+      }
+    }
+    --size_;
+  }
+
+  void reserve(std::size_t count, const auto& tree, auto size) {
+    if (count > capacity_) {
+      _resize(count);
+      _fill(tree, static_cast<std::size_t>(size));
+    }
+  }
+
+  void clear() noexcept {
+    for (auto& block : blocks_) { block = Block(); }
+    size_ = 0;
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    return blocks_.capacity() * sizeof(Block);
+  }
+
+private:
+  static std::uint64_t _hash(const Key& key) {
+    // Murmur3 finalizer, std::hash is the identity for integers
+    std::uint64_t hash = static_cast<std::uint64_t>(Hash()(key));
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  void _add(const Key& key) {
+    std::uint64_t hash = _hash(key);
+    Block& block       = blocks_[(hash >> 32) & mask_];
+    for (std::size_t i {}; i < hashes_; ++i) {
+      auto& counter = block.counters_[(hash >> (i * 6)) & (block_size_ - 1)];
+      if (counter != std::numeric_limits<std::uint8_t>::max()) {
+        ++counter;
+      }
+    }
+  }
+
+  void _resize(std::size_t count) {
+    std::size_t numBlocks = 1;
+    while (numBlocks * block_size_ < count * counters_per_key_) {
+      numBlocks *= 2;
+    }
+    blocks_.assign(numBlocks, Block());
+    mask_     = numBlocks - 1;
+    capacity_ = numBlocks * block_size_ / counters_per_key_;
+  }
+
+  void _fill(const auto& tree, std::size_t size) {
+    for (std::size_t i {}; i < size; ++i) { _add(tree[i].pair_.first); }
+    size_ = size;
+  }
+
+  void _rebuild(const auto& tree, std::size_t size) {
+    _resize(capacity_ ? capacity_ * 2 : 64);
+    _fill(tree, size);
+  }
+};
+
+// Erase policy interface, FlatTreeNoTombstones is the eager default. The
+// tree calls swap whenever two slots exchange their pairs.
+struct FlatTreeNoTombstones {
+  constexpr static bool lazy_ = false;
+
+  [[nodiscard]] bool dead(std::size_t) const noexcept { return false; }
+
+  [[nodiscard]] std::size_t count() const noexcept { return 0; }
+
+  void swap(std::size_t, std::size_t) noexcept {}
+
+  void clear() noexcept {}
+
+  [[nodiscard]] std::size_t bytes() const noexcept { return 0; }
+};
+
+// One tombstone bit per slot. Erase only sets the bit, the nodes are
+// physically removed in one batch once tombstones exceed Percent of the
+// nodes in the tree.
+template <std::size_t Percent> class FlatTreeTombstones {
+  constexpr static std::size_t word_bits_ = 64;
+
+  std::vector<std::uint64_t> bits_;
+  std::size_t count_ {};
+
+public:
+  constexpr static bool lazy_ = true;
+
+  [[nodiscard]] bool dead(std::size_t index) const noexcept {
+    std::size_t word = index / word_bits_;
+    return word < bits_.size() && ((bits_[word] >> (index % word_bits_)) & 1);
+  }
+
+  [[nodiscard]] std::size_t count() const noexcept { return count_; }
+
+  [[nodiscard]] bool full(std::size_t nodes) const noexcept {
+    return count_ * 100 > nodes * Percent;
+  }
+
+  void mark(std::size_t index) {
+    _flip(index);
+    ++count_;
+  }
+
+  void revive(std::size_t index) {
+    _flip(index);
+    --count_;
+  }
+
+  void swap(std::size_t indexA, std::size_t indexB) {
+    if (count_ && dead(indexA) != dead(indexB)) {
+      _flip(indexA);
+      _flip(indexB);
+    }
+  }
+
+  void clear() noexcept {
+    bits_.clear();
+    count_ = 0;
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    return bits_.capacity() * sizeof(std::uint64_t);
+  }
+
+private:
+  void _flip(std::size_t index) {
+    std::size_t word = index / word_bits_;
+    if (word >= bits_.size()) {
+      bits_.resize(word + 1);
+    }
+    bits_[word] ^= std::uint64_t {1} << (index % word_bits_);
+  }
+};
+
+template <typename Erase> struct FlatTreeErase;
+
+template <> struct FlatTreeErase<EagerErase> {
+  using type = FlatTreeNoTombstones;
+};
+
+template <std::size_t Percent> struct FlatTreeErase<LazyErase<Percent>> {
+  using type = FlatTreeTombstones<Percent>;
+};
+
+// Without digests the hooks compile away
+struct FlatTreeNoDigest {
+  constexpr static bool merkle_ = false;
+
+  void touch(std::size_t) noexcept {}
+
+  void stale(const auto&, std::size_t) noexcept {}
+
+  void swap(std::size_t, std::size_t) noexcept {}
+
+  void clear() noexcept {}
+
+  [[nodiscard]] std::size_t bytes() const noexcept { return 0; }
+};
+
+// Every slot caches the sum of the element hashes in its subtree. A sum does
+// not depend on the shape, so maps holding the same elements have the same
+// root digest. The tree queues the slots whose subtree changed and sums them
+// again up to the root at the end of each insert and erase.
+template <typename Key, typename Value, typename KeyHash, typename ValueHash>
+struct FlatTreeDigest {
+  constexpr static bool merkle_ = true;
+
+  std::vector<std::uint64_t> sums_;
+  std::vector<std::size_t> dirty_;
+  // Keys whose value may have been assigned through a returned reference
+  std::vector<Key> stale_;
+  bool rebuild_ {};
+
+  [[nodiscard]] static std::uint64_t hash(const auto& pair) {
+    // Seeded, a zero hash would read as an absent element
+    auto hash =
+        _mix(static_cast<std::uint64_t>(KeyHash()(pair.first)) + seed_);
+    if constexpr (! std::is_same_v<Value, FlatSetEmptyType>) {
+      hash = _mix(hash ^ static_cast<std::uint64_t>(ValueHash()(pair.second)));
+    }
+    return hash;
+  }
+
+  void touch(std::size_t index) {
+    if (index >= sums_.size()) {
+      sums_.resize(index + 1);
+    }
+    dirty_.push_back(index);
+  }
+
+  // Past a quarter of the nodes one full rebuild is cheaper than the walks
+  void stale(const Key& key, std::size_t nodes) {
+    if (rebuild_) {
+      return;
+    }
+    if (stale_.size() * 4 > nodes) {
+      rebuild_ = true;
+      stale_.clear();
+      return;
+    }
+    stale_.push_back(key);
+  }
+
+  void swap(std::size_t indexA, std::size_t indexB) {
+    std::swap(sums_[indexA], sums_[indexB]);
+    for (auto& index : dirty_) {
+      index = (index == indexA) ? indexB : (index == indexB) ? indexA : index;
+    }
+  }
+
+  void clear() noexcept {
+    sums_.clear();
+    dirty_.clear();
+    stale_.clear();
+    rebuild_ = false;
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    std::size_t bytes = sums_.capacity() * sizeof(std::uint64_t) +
+                        dirty_.capacity() * sizeof(std::size_t) +
+                        stale_.capacity() * sizeof(Key);
+    for (const auto& key : stale_) { bytes += HeapBytes<Key> {}(key); }
+    return bytes;
+  }
+
+private:
+  constexpr static std::uint64_t seed_ = 0x9e3779b97f4a7c15;
+
+  // SplitMix64 finalizer, spreads the identity hash of integers
+  static std::uint64_t _mix(std::uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111eb;
+    return hash ^ (hash >> 31);
+  }
+};
+
+// Vector of nodes that marks the chunk of every slot reached through a
+// non-const subscript. The tree writes nodes only through operator[], so a
+// clean chunk is unchanged since the last checkpoint. The fix ups form
+// references to empty_index_ without touching them, indices past the end
+// mark nothing.
+template <typename Node, std::size_t ChunkNodes>
+class FlatTreeDirtyVector : public std::vector<Node> {
+  using base_type = std::vector<Node>;
+
+  std::vector<std::uint8_t> dirty_;
+
+public:
+  constexpr static bool checkpoint_   = true;
+  constexpr static std::size_t chunk_ = ChunkNodes;
+
+  using base_type::base_type;
+
+  Node& operator[](std::size_t index) {
+    // Chunks past the marks are dirty already
+    std::size_t chunk = index / ChunkNodes;
+    if (index < base_type::size() && chunk < dirty_.size()) {
+      dirty_[chunk] = 1;
+    }
+    return base_type::operator[](index);
+  }
+
+  const Node& operator[](std::size_t index) const {
+    return base_type::operator[](index);
+  }
+
+  // Chunks past the marks were never written, they count as dirty
+  [[nodiscard]] bool dirty(std::size_t chunk) const noexcept {
+    return chunk >= dirty_.size() || dirty_[chunk];
+  }
+
+  void clean(std::size_t chunks) { dirty_.assign(chunks, 0); }
+
+  // Chunk flags, the nodes are counted as the vector's
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    return dirty_.capacity();
+  }
+};
+
+template <typename Storage> struct FlatTreeStorage;
+
+template <> struct FlatTreeStorage<VectorStorage> {
+  template <typename Node> using type = std::vector<Node>;
+  constexpr static bool checkpoint_   = false;
+};
+
+template <std::size_t ChunkNodes>
+struct FlatTreeStorage<CheckpointStorage<ChunkNodes>> {
+  static_assert(ChunkNodes > 0, "Chunks hold at least one node");
+  template <typename Node>
+  using type = FlatTreeDirtyVector<Node, ChunkNodes>;
+  constexpr static bool checkpoint_ = true;
+};
+
+// Without a top cache the hooks compile away
+struct FlatTreeNoTopCache {
+  constexpr static bool cached_ = false;
+
+  void touch(std::size_t) noexcept {}
+
+  void clear() noexcept {}
+
+  [[nodiscard]] std::size_t bytes() const noexcept { return 0; }
+};
+
+// Keys of the top Levels levels of the tree in breadth first order, next to
+// their slots, and the slots one level below to go on from. A search reads
+// the first Levels keys from this small array instead of nodes spread over
+// the tree. The tree marks the cache stale when a change reaches a cached
+// slot and builds it again at the end of the insert or erase. Small trees
+// fit in cache anyway and change their top on most inserts, the cache is
+// only kept from threshold_ nodes on.
+template <typename Key, Integral MaxSize, std::size_t Levels>
+struct FlatTreeTopCache {
+  static_assert(Levels > 0 && Levels < 24, "Levels is between 1 and 23");
+  constexpr static bool cached_           = true;
+  constexpr static std::size_t inner_     = (std::size_t {1} << Levels) - 1;
+  constexpr static std::size_t threshold_ = std::size_t {16} << Levels;
+
+  struct Entry {
+    Key key_ {};
+    MaxSize node_ {};
+  };
+
+  std::vector<Entry> entries_;
+  std::vector<MaxSize> frontier_;
+  // Slots held in entries_ or frontier_
+  std::vector<bool> top_;
+  bool stale_ = true;
+
+  void touch(std::size_t index) noexcept {
+    stale_ = stale_ || (index < top_.size() && top_[index]);
+  }
+
+  void clear() noexcept {
+    entries_.clear();
+    frontier_.clear();
+    top_.clear();
+    stale_ = true;
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    std::size_t bytes = entries_.capacity() * sizeof(Entry) +
+                        frontier_.capacity() * sizeof(MaxSize) +
+                        top_.capacity() / CHAR_BIT;
+    for (const auto& entry : entries_) {
+      bytes += HeapBytes<Key> {}(entry.key_);
+    }
+    return bytes;
+  }
+};
+
+// Counts of dro::OperationStats. A search is a descent from the root for
+// find, a bound or an insert location, depth sums the nodes it visited.
+// Fix loop steps count the rebalancing of bottom up and rank balanced trees.
+// Comparisons count the ordering and the equality checks of keys, resizes
+// every growth of the node array, reserve included.
+struct FlatTreeStats {
+  std::uint64_t comparisons_ {};
+  std::uint64_t searches_ {};
+  std::uint64_t depth_ {};
+  std::uint64_t rotations_ {};
+  std::uint64_t relocations_ {};
+  std::uint64_t fixInsert_ {};
+  std::uint64_t fixErase_ {};
+  std::uint64_t extremaHits_ {};
+  std::uint64_t resizes_ {};
+};
+
+// Counts of this thread for the depth and rotations of the probes, kept
+// without a stats policy. The probes pass the difference to the entry mark.
+#ifdef DRO_FLAT_PROBE_COUNTS
+using FlatTreeProbeMark = FlatTreeStats;
+
+inline thread_local FlatTreeStats flatTreeProbeCounts {};
+#else
+struct FlatTreeProbeMark {};
+#endif
+
+// Bytes of a tree, see memory_usage. Nodes and padding count every node in
+// [0, size), tombstones included, padding is the part of the nodes that is
+// neither key, value, links nor color. Dead capacity is the allocated slots
+// past the nodes. Allocator overhead is known for std::allocator on glibc
+// only, zero otherwise. Policies are the heap of the lookup index,
+// tombstones, digests, top cache, checkpoint flags and savepoint log.
+struct FlatTreeMemory {
+  std::size_t object_ {};
+  std::size_t nodes_ {};
+  std::size_t padding_ {};
+  std::size_t deadCapacity_ {};
+  std::size_t allocator_ {};
+  std::size_t heap_ {};
+  std::size_t policies_ {};
+  std::size_t total_ {};
+};
+
+// Placement of the nodes in the node array, see layout_report. The root is
+// at depth zero. Bucket b of heapDistance_ counts the links whose child slot
+// is a distance of bit width b from the heap slot 2 * parent + 1 + right,
+// bucket zero is the heap slot itself. The fractions are of the parent to
+// child links and of the in-order neighbors.
+struct FlatTreeLayout {
+  constexpr static std::size_t cache_line_ = 64;
+  constexpr static std::size_t page_       = 4096;
+
+  std::size_t nodes_ {};
+  std::size_t height_ {};
+  double averageDepth_ {};
+  std::size_t maxDepth_ {};
+  std::size_t blackHeight_ {};
+  std::array<std::size_t, std::numeric_limits<std::size_t>::digits + 1>
+      heapDistance_ {};
+  double cacheLineCrossings_ {};
+  double pageCrossings_ {};
+  double inOrderAdjacent_ {};
+  double inOrderSameLine_ {};
+};
+
+// Timed phases of the bottom up insert and erase of dro::PhaseStats
+enum class FlatTreePhase : std::uint8_t {
+  InsertExtrema,
+  InsertLocation,
+  InsertResize,
+  InsertInit,
+  InsertFix,
+  EraseFind,
+  EraseNeighbors,
+  EraseUnlink,
+  EraseSwap,
+  EraseFix,
+  Count
+};
+
+// Bucket b of histogram_ counts the runs of a bit width b in nanoseconds
+struct FlatTreePhaseTimes {
+  std::uint64_t count_ {};
+  std::uint64_t nanoseconds_ {};
+  std::array<std::uint64_t, 64> histogram_ {};
+};
+
+struct FlatTreeTimes {
+  std::array<FlatTreePhaseTimes,
+             static_cast<std::size_t>(FlatTreePhase::Count)>
+      phases_ {};
+
+  [[nodiscard]] const FlatTreePhaseTimes&
+  operator[](FlatTreePhase phase) const noexcept {
+    return phases_[static_cast<std::size_t>(phase)];
+  }
+};
+
+// Without stats the counters compile away
+struct FlatTreeNoCounters {
+  constexpr static bool stats_ = false;
+  constexpr static bool timed_ = false;
+
+  struct mark_type {};
+
+  void add([[maybe_unused]] std::uint64_t FlatTreeStats::*counter,
+           [[maybe_unused]] std::uint64_t count = 1) noexcept {
+#ifdef DRO_FLAT_PROBE_COUNTS
+    flatTreeProbeCounts.*counter += count;
+#endif
+  }
+
+  [[nodiscard]] mark_type now() const noexcept { return {}; }
+
+  void phase(FlatTreePhase, mark_type&) noexcept {}
+};
+
+struct FlatTreeCounters : FlatTreeNoCounters {
+  constexpr static bool stats_ = true;
+
+  FlatTreeStats counts_;
+
+  void add(std::uint64_t FlatTreeStats::*counter,
+           std::uint64_t count = 1) noexcept {
+    FlatTreeNoCounters::add(counter, count);
+    counts_.*counter += count;
+  }
+
+  void reset() noexcept { counts_ = FlatTreeStats {}; }
+};
+
+// Each phase ends at the next mark, two clock reads per phase
+struct FlatTreeTimedCounters : FlatTreeCounters {
+  constexpr static bool timed_ = true;
+
+  using mark_type = std::chrono::steady_clock::time_point;
+
+  FlatTreeTimes times_;
+
+  [[nodiscard]] mark_type now() const noexcept {
+    return std::chrono::steady_clock::now();
+  }
+
+  void phase(FlatTreePhase phase, mark_type& mark) noexcept {
+    mark_type end = now();
+    auto elapsed  = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - mark)
+            .count());
+    auto& times = times_.phases_[static_cast<std::size_t>(phase)];
+    ++times.count_;
+    times.nanoseconds_ += elapsed;
+    ++times.histogram_[std::min<std::size_t>(std::bit_width(elapsed), 63)];
+    mark = end;
+  }
+
+  void reset() noexcept {
+    FlatTreeCounters::reset();
+    times_ = FlatTreeTimes {};
+  }
+};
+
+template <typename Stats> struct FlatTreeStatsPolicy;
+
+template <> struct FlatTreeStatsPolicy<NoStats> {
+  using type = FlatTreeNoCounters;
+};
+
+template <> struct FlatTreeStatsPolicy<OperationStats> {
+  using type = FlatTreeCounters;
+};
+
+template <> struct FlatTreeStatsPolicy<PhaseStats> {
+  using type = FlatTreeTimedCounters;
+};
+
+template <typename TopCache, typename Key, Integral MaxSize>
+struct FlatTreeTop;
+
+template <typename Key, Integral MaxSize>
+struct FlatTreeTop<NoTopCache, Key, MaxSize> {
+  using type = FlatTreeNoTopCache;
+};
+
+template <std::size_t Levels, typename Key, Integral MaxSize>
+struct FlatTreeTop<TopKeyCache<Levels>, Key, MaxSize> {
+  using type = FlatTreeTopCache<Key, MaxSize, Levels>;
+};
+
+// Checkpoint files are a sequence of records. A chunk record is followed by
+// its nodes, a manifest record commits every chunk written before it.
+struct FlatTreeCheckpointRecord {
+  constexpr static std::uint64_t magic_value_ = 0x74706b6365686344;
+  constexpr static std::uint64_t chunk_       = 0;
+  constexpr static std::uint64_t manifest_    = 1;
+
+  std::uint64_t magic_ = magic_value_;
+  std::uint64_t kind_ {};
+  std::uint64_t nodeBytes_ {};
+  std::uint64_t chunkNodes_ {};
+  // Chunk index and node count, or size and root of the tree
+  std::uint64_t index_ {};
+  std::uint64_t count_ {};
+  std::uint64_t first_ {};
+  std::uint64_t last_ {};
+};
+
+// Kinds of change kept in the undo log of a savepoint
+enum class FlatTreeUndo : std::uint8_t { Insert, Erase, Assign };
+
+// Without savepoints the undo hooks compile away
+struct FlatTreeNoUndo {
+  constexpr static bool undo_ = false;
+
+  [[nodiscard]] bool logging() const noexcept { return false; }
+
+  template <typename Pair> void log(FlatTreeUndo, const Pair&) noexcept {}
+
+  void clear() noexcept {}
+
+  [[nodiscard]] std::size_t bytes() const noexcept { return 0; }
+};
+
+// Changes since the oldest savepoint with the old pair, and the log size at
+// each savepoint. Nothing is logged while no savepoint is open.
+template <typename Pair> struct FlatTreeUndoLog {
+  static_assert(std::is_copy_constructible_v<Pair>,
+                "dro::UndoSavepoints copies the old elements into the log, "
+                "the key and value must be copyable");
+  constexpr static bool undo_ = true;
+
+  std::vector<std::pair<FlatTreeUndo, Pair>> log_;
+  std::vector<std::size_t> savepoints_;
+
+  [[nodiscard]] bool logging() const noexcept { return ! savepoints_.empty(); }
+
+  void log(FlatTreeUndo kind, const Pair& pair) {
+    if (logging()) {
+      log_.emplace_back(kind, pair);
+    }
+  }
+
+  void clear() noexcept {
+    log_.clear();
+    savepoints_.clear();
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept {
+    using key_type    = decltype(Pair::first);
+    using mapped_type = decltype(Pair::second);
+    std::size_t bytes = log_.capacity() * sizeof(log_.front()) +
+                        savepoints_.capacity() * sizeof(std::size_t);
+    if constexpr (HeapBytes<key_type>::owns_ ||
+                  HeapBytes<mapped_type>::owns_) {
+      for (const auto& entry : log_) {
+        bytes += HeapBytes<key_type> {}(entry.second.first) +
+                 HeapBytes<mapped_type> {}(entry.second.second);
+      }
+    }
+    return bytes;
+  }
+};
+
+template <typename Savepoint, typename Pair> struct FlatTreeSavepoint;
+
+template <typename Pair> struct FlatTreeSavepoint<NoSavepoints, Pair> {
+  using type = FlatTreeNoUndo;
+};
+
+template <typename Pair> struct FlatTreeSavepoint<UndoSavepoints, Pair> {
+  using type = FlatTreeUndoLog<Pair>;
+};
+
+template <typename Merkle, typename Key, typename Value> struct FlatTreeMerkle;
+
+template <typename Key, typename Value>
+struct FlatTreeMerkle<NoMerkleHash, Key, Value> {
+  using type = FlatTreeNoDigest;
+};
+
+template <typename Hash, typename Key, typename Value>
+struct FlatTreeMerkle<MerkleHash<Hash>, Key, Value> {
+  using type =
+      FlatTreeDigest<Key, Value, std::conditional_t<std::is_void_v<Hash>,
+                                                    std::hash<Key>, Hash>,
+                     std::conditional_t<std::is_void_v<Hash>,
+                                        std::hash<Value>, Hash>>;
+};
+
+template <typename Hash, typename Key>
+using FlatTreeHash =
+    std::conditional_t<std::is_void_v<Hash>, std::hash<Key>, Hash>;
+
+template <typename Lookup, typename Key, Integral MaxSize>
+struct FlatTreeLookup;
+
+template <typename Key, Integral MaxSize>
+struct FlatTreeLookup<NoLookupIndex, Key, MaxSize> {
+  using type = FlatTreeNoIndex;
+};
+
+template <typename Hash, typename Key, Integral MaxSize>
+struct FlatTreeLookup<HashLookupIndex<Hash>, Key, MaxSize> {
+  using type = FlatTreeHashIndex<Key, MaxSize, FlatTreeHash<Hash, Key>>;
+};
+
+template <typename Hash, typename Key, Integral MaxSize>
+struct FlatTreeLookup<BloomLookupFilter<Hash>, Key, MaxSize> {
+  using type = FlatTreeBloomFilter<Key, MaxSize, FlatTreeHash<Hash, Key>>;
+};
+
+template <typename Balance> struct FlatTreeBalance;
+
+template <> struct FlatTreeBalance<RedBlackBalance> {
+  template <typename Pair, typename MaxSize>
+  using node_type                = Node<Pair, MaxSize, true>;
+  constexpr static bool parent_ = true;
+  constexpr static bool rank_   = false;
+  constexpr static bool weak_   = false;
+};
+
+template <> struct FlatTreeBalance<TopDownRedBlackBalance> {
+  template <typename Pair, typename MaxSize>
+  using node_type                = Node<Pair, MaxSize, false>;
+  constexpr static bool parent_ = false;
+  constexpr static bool rank_   = false;
+  constexpr static bool weak_   = false;
+};
+
+// Rank is the height, children ranks differ by at most one
+template <> struct FlatTreeBalance<AVLBalance> {
+  template <typename Pair, typename MaxSize>
+  using node_type                = RankNode<Pair, MaxSize>;
+  constexpr static bool parent_ = false;
+  constexpr static bool rank_   = true;
+  constexpr static bool weak_   = false;
+};
+
+// Rank differences are one or two and leaves have rank zero. Same as AVL
+// without erase, erase rotates at most twice.
+template <> struct FlatTreeBalance<WAVLBalance> {
+  template <typename Pair, typename MaxSize>
+  using node_type                = RankNode<Pair, MaxSize>;
+  constexpr static bool parent_ = false;
+  constexpr static bool rank_   = true;
+  constexpr static bool weak_   = true;
+};
+
 template <typename Container> struct FlatTreeIterator {
   using key_type        = typename Container::key_type;
   using mapped_type     = typename Container::mapped_type;
@@ -86,18 +1125,18 @@ template <typename Container> struct FlatTreeIterator {
 
   FlatTreeIterator& operator++() {
     if (reverse_) {
-      index_ = flatTree_->_prev(index_);
+      index_ = flatTree_->_prevLive(index_, path_);
     } else {
-      index_ = flatTree_->_next(index_);
+      index_ = flatTree_->_nextLive(index_, path_);
     }
     return *this;
   }
 
   FlatTreeIterator& operator--() {
     if (reverse_) {
-      index_ = flatTree_->_next(index_);
+      index_ = flatTree_->_nextLive(index_, path_);
     } else {
-      index_ = flatTree_->_prev(index_);
+      index_ = flatTree_->_prevLive(index_, path_);
     }
     return *this;
   }
@@ -130,10 +1169,12 @@ template <typename Container> struct FlatTreeIterator {
     return &flatTree_->tree_[index_].pair_.first;
   }
 
+  // The value may be written through the reference, the digest sums it again
   reference operator*() const
     requires(! std::is_same_v<mapped_type, FlatSetEmptyType> &&
              ! std::is_const_v<Container>)
   {
+    flatTree_->_staleValue(index_);
     return flatTree_->tree_[index_].pair_;
   }
 
@@ -148,6 +1189,7 @@ template <typename Container> struct FlatTreeIterator {
     requires(! std::is_same_v<mapped_type, FlatSetEmptyType> &&
              ! std::is_const_v<Container>)
   {
+    flatTree_->_staleValue(index_);
     return &flatTree_->tree_[index_].pair_;
   }
 
@@ -162,12 +1204,22 @@ private:
   Container* flatTree_ = nullptr;
   size_type index_ {};
   bool reverse_ {};
+  // Ancestors of the node when the tree has no parent links
+  [[no_unique_address]] typename Container::path_type path_ {};
   friend Container;
 };
 
 template <FlatTree_Type Key, FlatTree_Type Value, typename Pair,
           Integral MaxSize = std::size_t, typename Compare = std::less<Key>,
-          typename Allocator = std::allocator<Node<Pair, MaxSize>>>
+          typename Allocator = std::allocator<Node<Pair, MaxSize>>,
+          typename Lookup    = NoLookupIndex,
+          typename Balance   = RedBlackBalance,
+          typename Erase     = EagerErase,
+          typename Merkle    = NoMerkleHash,
+          typename Storage   = VectorStorage,
+          typename TopCache  = NoTopCache,
+          typename Stats     = NoStats,
+          typename Savepoint = NoSavepoints>
 class FlatRBTree {
 
 public:
@@ -190,19 +1242,59 @@ public:
   using const_pointer =
       std::conditional_t<std::is_same_v<mapped_type, FlatSetEmptyType>,
                          const key_type*, const value_type*>;
-  using node_type = Node<value_type, size_type>;
+  using node_type = typename FlatTreeBalance<Balance>::template node_type<
+      value_type, size_type>;
   using tree_type = std::vector<node_type, Allocator>;
-  using self_type = FlatRBTree<key_type, mapped_type, value_type, size_type,
-                               key_compare, allocator_type>;
+  using self_type   = FlatRBTree<key_type, mapped_type, value_type, size_type,
+                                 key_compare, allocator_type, Lookup, Balance,
+                                 Erase, Merkle, Storage, TopCache, Stats,
+                                 Savepoint>;
+  using lookup_type     = typename FlatTreeLookup<Lookup, Key, MaxSize>::type;
+  using tombstones_type = typename FlatTreeErase<Erase>::type;
+  using digest_type =
+      typename FlatTreeMerkle<Merkle, key_type, mapped_type>::type;
+  using storage_type =
+      typename FlatTreeStorage<Storage>::template type<node_type>;
+  using top_type = typename FlatTreeTop<TopCache, Key, MaxSize>::type;
+  using counters_type = typename FlatTreeStatsPolicy<Stats>::type;
+  using undo_type = typename FlatTreeSavepoint<Savepoint, value_type>::type;
   using iterator  = FlatTreeIterator<self_type>;
   using const_iterator         = FlatTreeIterator<const self_type>;
   using reverse_iterator       = FlatTreeIterator<self_type>;
   using const_reverse_iterator = FlatTreeIterator<const self_type>;
+  using savepoint_type         = std::size_t;
 
 private:
   // Constants
-  constexpr static bool RED_   = false;
-  constexpr static bool BLACK_ = true;
+  constexpr static bool RED_    = false;
+  constexpr static bool BLACK_  = true;
+  constexpr static bool PARENT_ = FlatTreeBalance<Balance>::parent_;
+  constexpr static bool CHECKPOINT_ = FlatTreeStorage<Storage>::checkpoint_;
+  constexpr static bool RANK_   = FlatTreeBalance<Balance>::rank_;
+  constexpr static bool WEAK_   = FlatTreeBalance<Balance>::weak_;
+  // Deepest path of a weak AVL tree, a red black tree is as deep
+  constexpr static std::size_t max_depth_ =
+      2 * std::numeric_limits<size_type>::digits + 2;
+  // Ancestors of an iterator's node, root first, so a step to an ancestor
+  // pops the stack instead of searching from the root. Out of line and
+  // filled by the first step, a step is then amortised O(1) and copies of
+  // an iterator that has not stepped allocate nothing.
+  struct FlatTreePath {
+    std::vector<size_type> nodes_;
+    bool valid_ {};
+  };
+  struct FlatTreeNoPath {};
+  using path_type = std::conditional_t<PARENT_, FlatTreeNoPath, FlatTreePath>;
+  // Element of the bulk exports, the key alone for a set
+  using export_type =
+      std::conditional_t<std::is_same_v<mapped_type, FlatSetEmptyType>,
+                         key_type, value_type>;
+  static_assert(! digest_type::merkle_ || PARENT_,
+                "dro::MerkleHash sums up the parent links, it needs "
+                "dro::RedBlackBalance");
+  static_assert(! counters_type::timed_ || PARENT_,
+                "dro::PhaseStats times the bottom up insert and erase, it "
+                "needs dro::RedBlackBalance");
 
   size_type capacity_ {};
   size_type size_ {};
@@ -226,7 +1318,15 @@ private:
   size_type root_            = empty_index_;
   size_type firstIndexCache_ = empty_index_;
   size_type lastIndexCache_  = empty_index_;
-  std::vector<node_type> tree_;
+  storage_type tree_;
+  [[no_unique_address]] lookup_type lookup_;
+  [[no_unique_address]] tombstones_type tombstones_;
+  // Summed lazily by the const digest queries
+  [[no_unique_address]] mutable digest_type digest_;
+  [[no_unique_address]] top_type topCache_;
+  // Lookups count too, so the counters change in const member functions
+  [[no_unique_address]] mutable counters_type counters_;
+  [[no_unique_address]] undo_type undo_;
 
 public:
   explicit FlatRBTree(size_type capacity = 1, Allocator allocator = Allocator())
@@ -245,6 +1345,8 @@ public:
     if (index == empty_index_) {
       throw std::out_of_range("dro::FlatRBTree::at");
     }
+    digest_.stale(key, size_);
+    _logAssign(index);
     return tree_[index].pair_.second;
   }
 
@@ -261,14 +1363,24 @@ public:
   mapped_type& operator[](const key_type& key)
     requires(! std::is_same_v<mapped_type, FlatSetEmptyType>)
   {
-    size_type index = _emplace(key).first.index_;
+    auto result     = _emplace(key);
+    size_type index = result.first.index_;
+    digest_.stale(key, size_);
+    if (! result.second) {
+      _logAssign(index);
+    }
     return tree_[index].pair_.second;
   }
 
   mapped_type& operator[](key_type&& key)
     requires(! std::is_same_v<mapped_type, FlatSetEmptyType>)
   {
-    size_type index = _emplace(key).first.index_;
+    auto result     = _emplace(key);
+    size_type index = result.first.index_;
+    digest_.stale(tree_[index].pair_.first, size_);
+    if (! result.second) {
+      _logAssign(index);
+    }
     return tree_[index].pair_.second;
   }
 
@@ -311,15 +1423,20 @@ public:
   }
 
   // Capacity
-  [[nodiscard]] size_type size() const noexcept { return size_; }
+  [[nodiscard]] size_type size() const noexcept {
+    return size_ - static_cast<size_type>(tombstones_.count());
+  }
 
   [[nodiscard]] size_type max_size() const noexcept { return empty_index_; }
 
-  [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+  [[nodiscard]] bool empty() const noexcept { return size() == 0; }
 
   [[nodiscard]] size_type capacity() const noexcept { return capacity_; }
 
-  void reserve(size_type new_cap) { _resizeTree(new_cap); }
+  void reserve(size_type new_cap) {
+    _resizeTree(new_cap);
+    lookup_.reserve(new_cap, tree_, size_);
+  }
 
   void shrink_to_fit() {
     while (capacity_ > size_) {
@@ -329,11 +1446,43 @@ public:
   }
 
   // Modifiers
-  void clear() noexcept {
+  // Logs every element while a savepoint is open, which may throw
+  void clear() noexcept(! undo_type::undo_) {
+    if (undo_.logging()) {
+      for (size_type index {}; index < size_; ++index) {
+        if (! tombstones_.dead(index)) {
+          undo_.log(FlatTreeUndo::Erase, tree_[index].pair_);
+        }
+      }
+    }
     firstIndexCache_ = empty_index_;
     lastIndexCache_  = empty_index_;
     root_            = empty_index_;
     size_            = 0;
+    lookup_.clear();
+    tombstones_.clear();
+    digest_.clear();
+    topCache_.clear();
+  }
+
+  // Physically removes the tombstones of a lazy erase policy
+  void purge() {
+    if constexpr (tombstones_type::lazy_) {
+      std::vector<key_type> keys;
+      keys.reserve(tombstones_.count());
+      for (size_type index {}; index < size_; ++index) {
+        if (tombstones_.dead(index)) {
+          keys.push_back(tree_[index].pair_.first);
+        }
+      }
+      for (const auto& key : keys) {
+        _eraseNode<false>(key);
+        // The erased pair ends in the slot past the end
+        tombstones_.revive(size_);
+      }
+      _digestFlush();
+      _topFlush();
+    }
   }
 
   std::pair<iterator, bool> insert(const value_type& pair)
@@ -376,7 +1525,10 @@ public:
                                                        M&& obj) {
     auto result = emplace(k, std::forward<M>(obj));
     if (! result.second) {
+      _logAssign(result.first.index_);
       result.first->second = std::forward<M>(obj);
+      digest_.touch(result.first.index_);
+      _digestFlush();
     }
     return result;
   }
@@ -385,7 +1537,10 @@ public:
   constexpr std::pair<iterator, bool> insert_or_assign(key_type&& k, M&& obj) {
     auto result = emplace(std::move(k), std::forward<M>(obj));
     if (! result.second) {
+      _logAssign(result.first.index_);
       result.first->second = std::forward<M>(obj);
+      digest_.touch(result.first.index_);
+      _digestFlush();
     }
     return result;
   }
@@ -410,7 +1565,7 @@ public:
     }
     size_type index = pos.index_;
     key_type key    = tree_[index].pair_.first;
-    return iterator(this, _erase(key, index).second);
+    return iterator(this, _erase<true>(key, index).second);
   }
 
   iterator erase(const_iterator pos) {
@@ -419,7 +1574,7 @@ public:
     }
     size_type index = pos.index_;
     key_type key    = tree_[index].pair_.first;
-    return iterator(this, _erase(key, index).second);
+    return iterator(this, _erase<true>(key, index).second);
   }
 
   iterator erase(iterator first, iterator last) {
@@ -428,7 +1583,7 @@ public:
     for (; first != last && first != end(); ++first) {
       size_type index = first.index_;
       key             = tree_[index].pair_.first;
-      upperIndex      = _erase(key, index).second;
+      upperIndex      = _erase<true>(key, index).second;
     }
     return iterator(this, upperIndex);
   }
@@ -439,18 +1594,90 @@ public:
     for (; first != last && first != cend(); ++first) {
       size_type index = first.index_;
       key             = tree_[index].pair_.first;
-      upperIndex      = _erase(key, index).second;
+      upperIndex      = _erase<true>(key, index).second;
     }
     return iterator(this, upperIndex);
   }
 
-  size_type erase(const key_type& key) { return _erase(key).first; }
+  size_type erase(const key_type& key) { return _erase<false>(key).first; }
 
   template <typename K>
   size_type erase(K&& x)
     requires std::is_convertible_v<K, key_type>
   {
-    return _erase(x).first;
+    return _erase<false>(x).first;
+  }
+
+  // Erase without finding the next element for a returned iterator
+  void erase_and_discard(iterator pos) {
+    if (pos != end()) {
+      size_type index = pos.index_;
+      key_type key    = tree_[index].pair_.first;
+      _erase<false>(key, index);
+    }
+  }
+
+  void erase_and_discard(const_iterator pos) {
+    if (pos != cend()) {
+      size_type index = pos.index_;
+      key_type key    = tree_[index].pair_.first;
+      _erase<false>(key, index);
+    }
+  }
+
+  // Marks a point that rollback returns to, changes are logged from here on
+  savepoint_type savepoint()
+    requires(undo_type::undo_)
+  {
+    undo_.savepoints_.push_back(undo_.log_.size());
+    return undo_.savepoints_.size() - 1;
+  }
+
+  // Undoes the changes since sp in reverse order, sp stays valid and the
+  // later savepoints are released
+  void rollback(savepoint_type sp)
+    requires(undo_type::undo_)
+  {
+    if (sp >= undo_.savepoints_.size()) {
+      throw std::out_of_range("dro::FlatRBTree::rollback");
+    }
+    std::size_t mark = undo_.savepoints_[sp];
+    // Replayed changes are not logged
+    std::vector<std::size_t> savepoints;
+    savepoints.swap(undo_.savepoints_);
+    while (undo_.log_.size() > mark) {
+      auto& [kind, pair] = undo_.log_.back();
+      if (kind == FlatTreeUndo::Insert) {
+        _erase<false>(pair.first);
+      } else if (kind == FlatTreeUndo::Erase) {
+        if constexpr (std::is_same_v<mapped_type, FlatSetEmptyType>) {
+          _emplace(std::move(pair.first));
+        } else {
+          _emplace(std::move(pair.first), std::move(pair.second));
+        }
+      } else {
+        size_type index           = _findIndex(pair.first);
+        tree_[index].pair_.second = std::move(pair.second);
+        digest_.touch(index);
+        _digestFlush();
+      }
+      undo_.log_.pop_back();
+    }
+    savepoints.resize(sp + 1);
+    undo_.savepoints_.swap(savepoints);
+  }
+
+  // Keeps the changes since sp, sp and the later savepoints end
+  void release(savepoint_type sp)
+    requires(undo_type::undo_)
+  {
+    if (sp >= undo_.savepoints_.size()) {
+      throw std::out_of_range("dro::FlatRBTree::release");
+    }
+    undo_.savepoints_.resize(sp);
+    if (undo_.savepoints_.empty()) {
+      undo_.log_.clear();
+    }
   }
 
   void swap(FlatRBTree& other) noexcept(FlatTree_NoThrow<Key> &&
@@ -526,69 +1753,485 @@ public:
     return {lower_bound(key), upper_bound(key)};
   }
 
-  [[nodiscard]] std::pair<const_iterator, const_iterator>
-  equal_range(const key_type& key) const {
-    return {lower_bound(key), upper_bound(key)};
+  [[nodiscard]] std::pair<const_iterator, const_iterator>
+  equal_range(const key_type& key) const {
+    return {lower_bound(key), upper_bound(key)};
+  }
+
+  template <typename K>
+  [[nodiscard]] std::pair<iterator, iterator> equal_range(const K& x)
+    requires std::is_convertible_v<K, key_type>
+  {
+    return {lower_bound(x), upper_bound(x)};
+  }
+  template <typename K>
+  [[nodiscard]] std::pair<const_iterator, const_iterator>
+  equal_range(const K& x) const
+    requires std::is_convertible_v<K, key_type>
+  {
+    return {lower_bound(x), upper_bound(x)};
+  }
+
+  [[nodiscard]] iterator lower_bound(const key_type& key) {
+    return iterator(this, _skipDead(_lowerBound(key)));
+  }
+
+  [[nodiscard]] const_iterator lower_bound(const key_type& key) const {
+    return const_iterator(this, _skipDead(_lowerBound(key)));
+  }
+
+  template <typename K>
+  [[nodiscard]] iterator lower_bound(const K& x)
+    requires std::is_convertible_v<K, key_type>
+  {
+    return iterator(this, _skipDead(_lowerBound(x)));
+  }
+  template <typename K>
+  [[nodiscard]] const_iterator lower_bound(const K& x) const
+    requires std::is_convertible_v<K, key_type>
+  {
+    return const_iterator(this, _skipDead(_lowerBound(x)));
+  }
+
+  [[nodiscard]] iterator upper_bound(const key_type& key) {
+    return iterator(this, _skipDead(_upperBound(key)));
+  }
+  [[nodiscard]] const_iterator upper_bound(const key_type& key) const {
+    return const_iterator(this, _skipDead(_upperBound(key)));
+  }
+  template <typename K>
+  [[nodiscard]] iterator upper_bound(const K& x)
+    requires std::is_convertible_v<K, key_type>
+  {
+    return iterator(this, _skipDead(_upperBound(x)));
+  }
+  template <typename K>
+  [[nodiscard]] const_iterator upper_bound(const K& x) const
+    requires std::is_convertible_v<K, key_type>
+  {
+    return const_iterator(this, _skipDead(_upperBound(x)));
+  }
+
+  // Export
+  // Sorted copy of the elements. With threads > 1 the subtrees below the top
+  // levels are copied on separate threads and joined in order, as many as
+  // the largest power of two up to threads.
+  [[nodiscard]] std::vector<export_type>
+  to_sorted_vector(std::size_t threads = 1) const {
+    std::vector<export_type> result;
+    result.reserve(size());
+    if (threads <= 1) {
+      _exportRange(root_, nullptr, nullptr, [&result](const auto& pair) {
+        result.push_back(_exportElement(pair));
+      });
+      return result;
+    }
+    // Subtrees and the single nodes between them, in key order
+    std::vector<std::pair<size_type, bool>> parts;
+    _exportParts(root_, std::bit_width(threads) - 1, parts);
+    std::vector<std::future<std::vector<export_type>>> futures;
+    for (const auto& [node, subtree] : parts) {
+      if (subtree) {
+        futures.push_back(std::async(std::launch::async, [this, node]() {
+          std::vector<export_type> part;
+          _exportRange(node, nullptr, nullptr, [&part](const auto& pair) {
+            part.push_back(_exportElement(pair));
+          });
+          return part;
+        }));
+      }
+    }
+    std::size_t next {};
+    for (const auto& [node, subtree] : parts) {
+      if (subtree) {
+        auto part = futures[next++].get();
+        result.insert(result.end(), part.begin(), part.end());
+      } else if (! tombstones_.dead(node)) {
+        result.push_back(_exportElement(tree_[node].pair_));
+      }
+    }
+    return result;
+  }
+
+  // Writes the sorted keys to out, returns the end of the output
+  template <typename OutputIt> OutputIt copy_keys(OutputIt out) const {
+    _exportRange(root_, nullptr, nullptr,
+                 [&out](const auto& pair) { *out++ = pair.first; });
+    return out;
+  }
+
+  // Writes the values in key order to out, returns the end of the output
+  template <typename OutputIt>
+  OutputIt copy_values(OutputIt out) const
+    requires (! std::is_same_v<mapped_type, FlatSetEmptyType>)
+  {
+    _exportRange(root_, nullptr, nullptr,
+                 [&out](const auto& pair) { *out++ = pair.second; });
+    return out;
+  }
+
+  // Calls callback with spans of up to chunk_size sorted elements, covering
+  // the keys in [low, high)
+  template <typename Callback>
+  void export_range(const key_type& low, const key_type& high,
+                    Callback callback, std::size_t chunk_size = 4096) const {
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    std::vector<export_type> chunk;
+    chunk.reserve(chunk_size);
+    _exportRange(root_, &low, &high, [&](const auto& pair) {
+      chunk.push_back(_exportElement(pair));
+      if (chunk.size() == chunk_size) {
+        callback(std::span<const export_type>(chunk));
+        chunk.clear();
+      }
+    });
+    if (! chunk.empty()) {
+      callback(std::span<const export_type>(chunk));
+    }
+  }
+
+  // Observers
+  [[nodiscard]] Compare key_comp() const noexcept { return Compare(); }
+
+  [[nodiscard]] Compare value_comp() const noexcept { return Compare(); }
+
+  // Stats
+  // Operation counts since construction or the last reset_stats
+  [[nodiscard]] FlatTreeStats stats() const noexcept
+    requires counters_type::stats_
+  {
+    return counters_.counts_;
+  }
+
+  // Times of the phases of the bottom up insert and erase, by phase
+  [[nodiscard]] FlatTreeTimes phase_times() const noexcept
+    requires counters_type::timed_
+  {
+    return counters_.times_;
   }
 
-  template <typename K>
-  [[nodiscard]] std::pair<iterator, iterator> equal_range(const K& x)
-    requires std::is_convertible_v<K, key_type>
+  void reset_stats() noexcept
+    requires counters_type::stats_
   {
-    return {lower_bound(x), upper_bound(x)};
+    counters_.reset();
   }
-  template <typename K>
-  [[nodiscard]] std::pair<const_iterator, const_iterator>
-  equal_range(const K& x) const
-    requires std::is_convertible_v<K, key_type>
-  {
-    return {lower_bound(x), upper_bound(x)};
+
+  // Layout
+  // Depths and the locality of the node array, to tell how far the churn has
+  // moved the nodes from a heap order. Tombstones count as nodes.
+  [[nodiscard]] FlatTreeLayout layout_report() const {
+    using layout_type = FlatTreeLayout;
+    layout_type report;
+    std::size_t depthSum {};
+    std::size_t lineHops {};
+    std::size_t pageHops {};
+    std::size_t adjacent {};
+    std::size_t sameLine {};
+    std::array<std::pair<size_type, std::size_t>, max_depth_> stack;
+    std::size_t top {};
+    std::size_t depth {};
+    size_type node = root_;
+    size_type prev = empty_index_;
+    while (node != empty_index_ || top) {
+      for (; node != empty_index_; node = tree_[node].left_, ++depth) {
+        stack[top++] = {node, depth};
+      }
+      --top;
+      node  = stack[top].first;
+      depth = stack[top].second;
+      ++report.nodes_;
+      depthSum         += depth;
+      report.maxDepth_  = std::max(report.maxDepth_, depth);
+      for (bool right : {false, true}) {
+        size_type child = right ? tree_[node].right_ : tree_[node].left_;
+        if (child == empty_index_) {
+          continue;
+        }
+        std::size_t heap = 2 * static_cast<std::size_t>(node) + 1 + right;
+        std::size_t distance = (child > heap) ? child - heap : heap - child;
+        ++report.heapDistance_[std::bit_width(distance)];
+        lineHops += _layoutBlock(node, layout_type::cache_line_) !=
+                    _layoutBlock(child, layout_type::cache_line_);
+        pageHops += _layoutBlock(node, layout_type::page_) !=
+                    _layoutBlock(child, layout_type::page_);
+      }
+      if (prev != empty_index_) {
+        adjacent += (node == prev + 1 || prev == node + 1);
+        sameLine += _layoutBlock(node, layout_type::cache_line_) ==
+                    _layoutBlock(prev, layout_type::cache_line_);
+      }
+      prev = node;
+      node = tree_[node].right_;
+      ++depth;
+    }
+    if (! report.nodes_) {
+      return report;
+    }
+    if constexpr (! RANK_) {
+      for (node = root_; node != empty_index_; node = tree_[node].left_) {
+        report.blackHeight_ += tree_[node].color_ == BLACK_;
+      }
+    }
+    auto nodes           = static_cast<double>(report.nodes_);
+    report.height_       = report.maxDepth_ + 1;
+    report.averageDepth_ = static_cast<double>(depthSum) / nodes;
+    if (report.nodes_ > 1) {
+      auto links                 = nodes - 1;
+      report.cacheLineCrossings_ = static_cast<double>(lineHops) / links;
+      report.pageCrossings_      = static_cast<double>(pageHops) / links;
+      report.inOrderAdjacent_    = static_cast<double>(adjacent) / links;
+      report.inOrderSameLine_    = static_cast<double>(sameLine) / links;
+    }
+    return report;
   }
 
-  [[nodiscard]] iterator lower_bound(const key_type& key) {
-    return iterator(this, _lowerBound(key));
+  // Memory
+  // Bytes held by the tree, walks the nodes only for keys or values that own
+  // heap memory
+  [[nodiscard]] FlatTreeMemory memory_usage() const {
+    using node_type = typename storage_type::value_type;
+    constexpr std::size_t links = PARENT_ ? 3 : 2;
+    constexpr std::size_t value_bytes =
+        std::is_same_v<mapped_type, FlatSetEmptyType> ? 0
+                                                      : sizeof(mapped_type);
+    constexpr std::size_t payload =
+        sizeof(key_type) + value_bytes + links * sizeof(size_type) + 1;
+    constexpr std::size_t padding =
+        sizeof(node_type) - std::min(sizeof(node_type), payload);
+    FlatTreeMemory memory;
+    std::size_t allocated = tree_.capacity() * sizeof(node_type);
+    memory.object_        = sizeof(*this);
+    memory.nodes_         = static_cast<std::size_t>(size_) * sizeof(node_type);
+    memory.padding_       = static_cast<std::size_t>(size_) * padding;
+    memory.deadCapacity_  = allocated - memory.nodes_;
+#if defined(__GLIBC__) && __has_include(<malloc.h>)
+    if constexpr (std::is_same_v<typename storage_type::allocator_type,
+                                 std::allocator<node_type>>) {
+      if (tree_.capacity()) {
+        // Usable size past the request, and the chunk header
+        void* data        = const_cast<node_type*>(tree_.data());
+        memory.allocator_ =
+            ::malloc_usable_size(data) - allocated + sizeof(std::size_t);
+      }
+    }
+#endif
+    if constexpr (HeapBytes<key_type>::owns_ ||
+                  HeapBytes<mapped_type>::owns_) {
+      for (std::size_t index {}; index < size_; ++index) {
+        memory.heap_ += HeapBytes<key_type> {}(tree_[index].pair_.first);
+        if constexpr (value_bytes) {
+          memory.heap_ += HeapBytes<mapped_type> {}(tree_[index].pair_.second);
+        }
+      }
+    }
+    memory.policies_ = lookup_.bytes() + tombstones_.bytes() +
+                       digest_.bytes() + topCache_.bytes() + undo_.bytes();
+    if constexpr (CHECKPOINT_) {
+      memory.policies_ += tree_.bytes();
+    }
+    memory.total_ = memory.object_ + allocated + memory.allocator_ +
+                    memory.heap_ + memory.policies_;
+    return memory;
   }
 
-  [[nodiscard]] const_iterator lower_bound(const key_type& key) const {
-    return const_iterator(this, _lowerBound(key));
+  // Writes the node array in slot order, one row per node with its key
+  // digest, links, color or rank, depth and in-order rank. Empty links are -1.
+  // DOT draws the same nodes as a graph.
+  void dump_layout(std::ostream& out,
+                   LayoutFormat format = LayoutFormat::CSV) const {
+    struct Row {
+      size_type parent_ = empty_index_;
+      std::size_t depth_ {};
+      std::size_t rank_ {};
+    };
+    std::vector<Row> rows(size_);
+    std::array<size_type, max_depth_> stack;
+    std::size_t top {};
+    std::size_t rank {};
+    size_type node = root_;
+    // Children take the parent and depth before they are visited
+    auto descend = [&rows](size_type parent, size_type child) {
+      if (child != empty_index_) {
+        rows[child].parent_ = parent;
+        rows[child].depth_  = rows[parent].depth_ + 1;
+      }
+    };
+    while (node != empty_index_ || top) {
+      for (; node != empty_index_; node = tree_[node].left_) {
+        descend(node, tree_[node].left_);
+        stack[top++] = node;
+      }
+      node             = stack[--top];
+      rows[node].rank_ = rank++;
+      descend(node, tree_[node].right_);
+      node = tree_[node].right_;
+    }
+    auto link = [&out](size_type index) -> std::ostream& {
+      if (index == empty_index_) {
+        return out << -1;
+      }
+      return out << static_cast<std::size_t>(index);
+    };
+    if (format == LayoutFormat::CSV) {
+      out << "index,digest,parent,left,right," << (RANK_ ? "rank" : "color")
+          << ",depth,inorder,dead\n";
+    } else {
+      out << "digraph FlatRBTree {\n  node [style=filled, fontcolor=white];\n";
+    }
+    for (std::size_t index {}; index < size_; ++index) {
+      const auto& nodeRef = tree_[index];
+      const Row& row      = rows[index];
+      bool dead           = tombstones_.dead(index);
+      if (format == LayoutFormat::CSV) {
+        out << index << ',' << _layoutDigest(nodeRef.pair_.first) << ',';
+        link(row.parent_) << ',';
+        link(nodeRef.left_) << ',';
+        link(nodeRef.right_) << ',';
+        if constexpr (RANK_) {
+          out << int {nodeRef.rank_};
+        } else {
+          out << (nodeRef.color_ == RED_ ? "red" : "black");
+        }
+        out << ',' << row.depth_ << ',' << row.rank_ << ',' << dead << '\n';
+        continue;
+      }
+      out << "  n" << index << " [label=\"" << index << "\\n"
+          << _layoutDigest(nodeRef.pair_.first) << "\", fillcolor=";
+      if constexpr (RANK_) {
+        out << "black, xlabel=" << int {nodeRef.rank_};
+      } else {
+        out << (nodeRef.color_ == RED_ ? "red" : "black");
+      }
+      out << (dead ? ", style=\"filled,dashed\"" : "") << "];\n";
+      for (size_type child : {nodeRef.left_, nodeRef.right_}) {
+        if (child != empty_index_) {
+          out << "  n" << index << " -> n" << static_cast<std::size_t>(child)
+              << ";\n";
+        }
+      }
+    }
+    if (format == LayoutFormat::DOT) {
+      out << "}\n";
+    }
   }
 
-  template <typename K>
-  [[nodiscard]] iterator lower_bound(const K& x)
-    requires std::is_convertible_v<K, key_type>
+  // Merkle
+  // Sum of the element hashes, maps with the same elements match
+  [[nodiscard]] std::uint64_t digest() const
+    requires digest_type::merkle_
   {
-    return iterator(this, _lowerBound(x));
+    _digestRefresh();
+    return _digestRoot();
   }
-  template <typename K>
-  [[nodiscard]] const_iterator lower_bound(const K& x) const
-    requires std::is_convertible_v<K, key_type>
+
+  // Sorted keys present in one map only or mapped to different values,
+  // skips every subtree whose digest matches the same key range of other
+  [[nodiscard]] std::vector<key_type> diff(const self_type& other) const
+    requires digest_type::merkle_
   {
-    return const_iterator(this, _lowerBound(x));
+    _digestRefresh();
+    other._digestRefresh();
+    std::vector<key_type> keys;
+    _diff(other, root_, nullptr, nullptr, 0, other._digestRoot(), keys);
+    return keys;
   }
 
-  [[nodiscard]] iterator upper_bound(const key_type& key) {
-    return iterator(this, _upperBound(key));
-  }
-  [[nodiscard]] const_iterator upper_bound(const key_type& key) const {
-    return const_iterator(this, _upperBound(key));
-  }
-  template <typename K>
-  [[nodiscard]] iterator upper_bound(const K& x)
-    requires std::is_convertible_v<K, key_type>
+  // Checkpoints
+  // Appends the chunks changed since the last checkpoint, or every chunk if
+  // full, and a manifest to fd. Tombstones are purged first.
+  void checkpoint(int fd, bool full = false)
+    requires CHECKPOINT_
   {
-    return iterator(this, _upperBound(x));
+    _writeCheckpoint(fd, _checkpointRecords(full));
   }
-  template <typename K>
-  [[nodiscard]] const_iterator upper_bound(const K& x) const
-    requires std::is_convertible_v<K, key_type>
+
+  // Copies the changed chunks now and writes them on another thread, the
+  // tree can change meanwhile. Wait on the future before the next checkpoint
+  // to the same fd.
+  [[nodiscard]] std::future<void> checkpoint_async(int fd, bool full = false)
+    requires CHECKPOINT_
   {
-    return const_iterator(this, _upperBound(x));
+    return std::async(std::launch::async,
+                      [fd, records = _checkpointRecords(full)]() {
+                        _writeCheckpoint(fd, records);
+                      });
   }
 
-  // Observers
-  [[nodiscard]] Compare key_comp() const noexcept { return Compare(); }
-
-  [[nodiscard]] Compare value_comp() const noexcept { return Compare(); }
+  // Replaces the contents with the last committed checkpoint in fd, read
+  // from offset zero. A torn write after the last manifest is cut off, so
+  // the next checkpoint appends to the committed records.
+  void recover(int fd)
+    requires CHECKPOINT_
+  {
+    using record_type = FlatTreeCheckpointRecord;
+    constexpr std::size_t chunkNodes = storage_type::chunk_;
+    std::vector<node_type> nodes;
+    std::vector<std::pair<std::size_t, std::vector<node_type>>> pending;
+    record_type manifest;
+    bool committed {};
+    record_type record;
+    off_t offset {};
+    off_t committedEnd {};
+    while (_readCheckpoint(fd, &record, sizeof(record), offset)) {
+      if (record.magic_ != record_type::magic_value_ ||
+          record.nodeBytes_ != sizeof(node_type) ||
+          record.chunkNodes_ != chunkNodes) {
+        break;
+      }
+      if (record.kind_ == record_type::manifest_) {
+        for (auto& [chunk, chunkNodesRef] : pending) {
+          std::size_t first = chunk * chunkNodes;
+          if (nodes.size() < first + chunkNodesRef.size()) {
+            nodes.resize(first + chunkNodesRef.size());
+          }
+          std::copy(chunkNodesRef.begin(), chunkNodesRef.end(),
+                    nodes.begin() + static_cast<std::ptrdiff_t>(first));
+        }
+        pending.clear();
+        manifest     = record;
+        committed    = true;
+        committedEnd = offset;
+        continue;
+      }
+      std::vector<node_type> chunkNodesRef(record.count_);
+      if (record.count_ > chunkNodes ||
+          ! _readCheckpoint(fd, chunkNodesRef.data(),
+                            record.count_ * sizeof(node_type), offset)) {
+        break;
+      }
+      pending.emplace_back(record.index_, std::move(chunkNodesRef));
+    }
+    if (! committed || ! _validManifest(manifest, nodes.size())) {
+      throw std::runtime_error("dro::FlatRBTree::recover");
+    }
+    // Cuts a torn tail off, a file without one may be read only
+    off_t end = ::lseek(fd, 0, SEEK_END);
+    if (end < 0 ||
+        (end > committedEnd && ::ftruncate(fd, committedEnd) != 0) ||
+        ::lseek(fd, committedEnd, SEEK_SET) < 0) {
+      throw std::runtime_error("dro::FlatRBTree::recover");
+    }
+    // Nothing to roll back to, clear does not log
+    undo_.clear();
+    clear();
+    size_            = static_cast<size_type>(manifest.index_);
+    root_            = static_cast<size_type>(manifest.count_);
+    firstIndexCache_ = static_cast<size_type>(manifest.first_);
+    lastIndexCache_  = static_cast<size_type>(manifest.last_);
+    capacity_        = std::max<size_type>(size_, 1);
+    tree_.assign(nodes.begin(),
+                 nodes.begin() + static_cast<std::ptrdiff_t>(size_));
+    tree_.resize(capacity_);
+    for (size_type index {}; index < size_; ++index) {
+      lookup_.insert(tree_[index].pair_.first, index, tree_, index + 1);
+    }
+    if constexpr (digest_type::merkle_) {
+      digest_.rebuild_ = true;
+    }
+    // Matches the file
+    tree_.clean((size_ + chunkNodes - 1) / chunkNodes);
+    _topFlush();
+  }
 
 private:
   // For FlatMap
@@ -597,26 +2240,83 @@ private:
     requires(std::is_convertible_v<K, key_type> &&
              std::is_constructible_v<mapped_type, Args && ...>)
   {
+    DRO_FLAT_PROBE(insert_entry, static_cast<std::uint64_t>(size_));
+    FlatTreeProbeMark probe = _probeMark();
     _validateSize();
+    if constexpr (lookup_type::exact_) {
+      size_type index = lookup_.find(key, tree_);
+      if (index != empty_index_) {
+        return _finishEmplace({iterator(this, index), false}, probe,
+                              std::forward<Args>(args)...);
+      }
+    }
+    if constexpr (PARENT_) {
+      return _finishEmplace(
+          _emplaceBottomUp(key, std::forward<Args>(args)...), probe,
+          std::forward<Args>(args)...);
+    } else if constexpr (RANK_) {
+      return _finishEmplace(_emplaceRank(key, std::forward<Args>(args)...),
+                            probe, std::forward<Args>(args)...);
+    } else {
+      return _finishEmplace(_emplaceTopDown(key, std::forward<Args>(args)...),
+                            probe, std::forward<Args>(args)...);
+    }
+  }
+
+  // Re-insert of a key with a tombstone reuses its node. The insert did not
+  // construct from args when the key was found.
+  template <typename... Args>
+  std::pair<iterator, bool>
+  _finishEmplace(std::pair<iterator, bool> result,
+                 [[maybe_unused]] const FlatTreeProbeMark& probe,
+                 Args&&... args) {
+    if constexpr (tombstones_type::lazy_) {
+      size_type index = result.first.index_;
+      if (! result.second && tombstones_.dead(index)) {
+        tombstones_.revive(index);
+        tree_[index].pair_.second = mapped_type(std::forward<Args>(args)...);
+        result.second             = true;
+        digest_.touch(index);
+      }
+    }
+    if (result.second) {
+      undo_.log(FlatTreeUndo::Insert, tree_[result.first.index_].pair_);
+    }
+    _digestFlush();
+    _topFlush();
+    DRO_FLAT_PROBE(insert_return, static_cast<std::uint64_t>(size_),
+                   result.second, _probeCount(probe, &FlatTreeStats::depth_),
+                   _probeCount(probe, &FlatTreeStats::rotations_));
+    return result;
+  }
+
+  // Value handed out by a non-const iterator, summed again by the digest
+  void _staleValue(size_type index) {
+    digest_.stale(tree_[index].pair_.first, size_);
+  }
+
+  // Old value of a key about to be assigned, or handed out by reference
+  void _logAssign(size_type index) {
+    undo_.log(FlatTreeUndo::Assign, tree_[index].pair_);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> _emplaceBottomUp(const key_type& key,
+                                             Args&&... args) {
     size_type insertIndex = size_;
     size_type extremaCase {};
+    auto mark      = counters_.now();
     auto isExtrema = _checkCachedExtrema(key, extremaCase);
+    counters_.phase(FlatTreePhase::InsertExtrema, mark);
     auto insertResult =
         (! isExtrema.second) ? _findInsertLocation(key) : isExtrema;
+    counters_.phase(FlatTreePhase::InsertLocation, mark);
     if (! insertResult.second) {
       return {iterator(this, insertResult.first), false};
     }
-    // Create Node in the end of the tree
     size_type parent = insertResult.first;
-    _resizeTree();
-    auto& newNodeRef        = tree_[size_];
-    newNodeRef.pair_.first  = key;
-    newNodeRef.pair_.second = mapped_type(std::forward<Args>(args)...);
-    newNodeRef.parent_      = parent;
-    newNodeRef.left_        = empty_index_;
-    newNodeRef.right_       = empty_index_;
-    newNodeRef.color_       = RED_;
-    ++size_;
+    _createNode(key, parent, std::forward<Args>(args)...);
+    topCache_.touch(parent);
     // Update root_
     if (! insertIndex) {
       root_               = insertIndex;
@@ -625,11 +2325,373 @@ private:
       return {iterator(this, insertIndex), true};
     }
     _insertUpdateParentRoot(key, parent, insertIndex);
+    mark        = counters_.now();
     insertIndex = _fixInsert(insertIndex, key);
+    counters_.phase(FlatTreePhase::InsertFix, mark);
     _insertUpdateCachedExtrema(extremaCase, insertIndex);
     return {iterator(this, insertIndex), true};
   }
 
+  // Single pass insert, splits nodes with two red children on the way down
+  // so a red violation is fixed by one rotation at the grandparent. The
+  // rotations keep the subtree root in its slot and move the pairs, so only
+  // the slots of the moved keys change.
+  template <typename... Args>
+  std::pair<iterator, bool> _emplaceTopDown(const key_type& key,
+                                            Args&&... args) {
+    if (root_ == empty_index_) {
+      root_               = _createNode(key, empty_index_,
+                                        std::forward<Args>(args)...);
+      tree_[root_].color_ = BLACK_;
+      firstIndexCache_    = root_;
+      lastIndexCache_     = root_;
+      return {iterator(this, root_), true};
+    }
+    size_type grandparent = empty_index_;
+    size_type parent      = empty_index_;
+    size_type node        = root_;
+    bool dir {};
+    bool last {};
+    bool inserted {};
+    counters_.add(&FlatTreeStats::searches_);
+    while (true) {
+      counters_.add(&FlatTreeStats::depth_);
+      if (node == empty_index_) {
+        node = _createNode(key, empty_index_, std::forward<Args>(args)...);
+        _child(parent, dir) = node;
+        inserted            = true;
+        topCache_.touch(parent);
+      } else if (_isRed(tree_[node].left_) && _isRed(tree_[node].right_)) {
+        // Color flip
+        tree_[node].color_               = RED_;
+        tree_[tree_[node].left_].color_  = BLACK_;
+        tree_[tree_[node].right_].color_ = BLACK_;
+      }
+      // Parent is red so it is not the root, grandparent exists
+      if (_isRed(node) && _isRed(parent)) {
+        if (node == _child(parent, last)) {
+          _rotate(grandparent, ! last);
+          parent = grandparent;
+        } else {
+          _rotate(parent, last);
+          _rotate(grandparent, ! last);
+          node = grandparent;
+        }
+        tree_[grandparent].color_ = BLACK_;
+        tree_[_child(grandparent, false)].color_ = RED_;
+        tree_[_child(grandparent, true)].color_  = RED_;
+      }
+      if (_equal(key, tree_[node].pair_.first)) {
+        break;
+      }
+      last        = dir;
+      dir         = _less(tree_[node].pair_.first, key);
+      grandparent = parent;
+      parent      = node;
+      node        = _child(node, dir);
+    }
+    tree_[root_].color_ = BLACK_;
+    if (inserted) {
+      if (_less(key, tree_[firstIndexCache_].pair_.first)) {
+        firstIndexCache_ = node;
+      }
+      if (_less(tree_[lastIndexCache_].pair_.first, key)) {
+        lastIndexCache_ = node;
+      }
+    }
+    return {iterator(this, node), inserted};
+  }
+
+  // Insert of a rank balanced tree. The new leaf has rank zero, ranks are
+  // promoted up the path while a node has the rank of its parent, and one
+  // single or double rotation ends the walk.
+  template <typename... Args>
+  std::pair<iterator, bool> _emplaceRank(const key_type& key, Args&&... args) {
+    counters_.add(&FlatTreeStats::searches_);
+    std::array<size_type, max_depth_> path;
+    std::size_t depth {};
+    size_type node = root_;
+    bool dir {};
+    while (node != empty_index_) {
+      auto& nodeRef = tree_[node];
+      _prefetchBinarySearch(nodeRef);
+      counters_.add(&FlatTreeStats::depth_);
+      if (_equal(key, nodeRef.pair_.first)) {
+        return {iterator(this, node), false};
+      }
+      path[depth++] = node;
+      dir           = _less(nodeRef.pair_.first, key);
+      node          = dir ? nodeRef.right_ : nodeRef.left_;
+    }
+    size_type inserted =
+        _createNode(key, empty_index_, std::forward<Args>(args)...);
+    if (! depth) {
+      root_            = inserted;
+      firstIndexCache_ = inserted;
+      lastIndexCache_  = inserted;
+      return {iterator(this, inserted), true};
+    }
+    _child(path[depth - 1], dir) = inserted;
+    topCache_.touch(path[depth - 1]);
+    if (_less(key, tree_[firstIndexCache_].pair_.first)) {
+      firstIndexCache_ = inserted;
+    }
+    if (_less(tree_[lastIndexCache_].pair_.first, key)) {
+      lastIndexCache_ = inserted;
+    }
+    node = inserted;
+    while (depth) {
+      counters_.add(&FlatTreeStats::fixInsert_);
+      size_type parent = path[--depth];
+      // Stop once node is not a zero child
+      if (_rank(parent) != _rank(node)) {
+        break;
+      }
+      bool side = (tree_[parent].right_ == node);
+      if (_rank(parent) - _rank(_child(parent, ! side)) == 1) {
+        ++tree_[parent].rank_;
+        node = parent;
+        continue;
+      }
+      size_type inner = _child(node, ! side);
+      if (_rank(node) - _rank(inner) == 2) {
+        _rotateTracked(parent, ! side, inserted);
+        --tree_[node].rank_;
+      } else {
+        _rotateTracked(node, side, inserted);
+        _rotateTracked(parent, ! side, inserted);
+        ++tree_[parent].rank_;
+        --tree_[node].rank_;
+        --tree_[inner].rank_;
+      }
+      break;
+    }
+    return {iterator(this, inserted), true};
+  }
+
+  // Erase of a rank balanced tree, a key with two children takes the pair of
+  // its in-order successor, which is removed instead
+  template <bool Track>
+  std::pair<bool, size_type> _eraseRank(const key_type& key, size_type index) {
+    std::array<size_type, max_depth_> path;
+    std::size_t depth {};
+    size_type node = root_;
+    counters_.add(&FlatTreeStats::searches_);
+    while (node != empty_index_ && ! _equal(key, tree_[node].pair_.first)) {
+      counters_.add(&FlatTreeStats::depth_);
+      path[depth++] = node;
+      node          = _child(node, _less(tree_[node].pair_.first, key));
+    }
+    if (node == empty_index_) {
+      return {false, empty_index_};
+    }
+    lookup_.erase(tree_[node].pair_.first, node);
+    topCache_.touch(node);
+    const bool smallestElem = (node == firstIndexCache_);
+    const bool largestElem  = (node == lastIndexCache_);
+    if (tree_[node].left_ != empty_index_ &&
+        tree_[node].right_ != empty_index_) {
+      size_type found = node;
+      path[depth++]   = node;
+      node            = tree_[node].right_;
+      while (tree_[node].left_ != empty_index_) {
+        path[depth++] = node;
+        node          = tree_[node].left_;
+      }
+      lookup_.relocate(tree_[node].pair_.first, node, found);
+      tombstones_.swap(node, found);
+      std::swap(tree_[found].pair_, tree_[node].pair_);
+      lastIndexCache_ = (lastIndexCache_ == node) ? found : lastIndexCache_;
+    }
+    // Unlink the bottom node, it has at most one child
+    size_type child = (tree_[node].left_ == empty_index_) ? tree_[node].right_
+                                                          : tree_[node].left_;
+    bool side       = false;
+    if (! depth) {
+      root_ = child;
+    } else {
+      side = (tree_[path[depth - 1]].right_ == node);
+      _child(path[depth - 1], side) = child;
+    }
+    if constexpr (WEAK_) {
+      _eraseFixWeak(path, depth, child, side);
+    } else {
+      _eraseFixAVL(path, depth);
+    }
+    _fillSlot(node);
+    --size_;
+    if (smallestElem) {
+      firstIndexCache_ = _extremum(false);
+    }
+    if (largestElem) {
+      lastIndexCache_ = _extremum(true);
+    }
+    return {true, Track ? _upperBound(key) : empty_index_};
+  }
+
+  // Recomputes the heights up the path, stops once a height is unchanged
+  void _eraseFixAVL(const auto& path, std::size_t depth) {
+    while (depth) {
+      counters_.add(&FlatTreeStats::fixErase_);
+      size_type node = path[--depth];
+      int rank       = _rank(node);
+      int balance = _rank(tree_[node].right_) - _rank(tree_[node].left_);
+      if (balance > 1 || balance < -1) {
+        bool side      = (balance > 0);
+        size_type high = _child(node, side);
+        if (_rank(_child(high, ! side)) > _rank(_child(high, side))) {
+          _rotate(high, side);
+        }
+        _rotate(node, ! side);
+        _updateRank(tree_[node].left_);
+        _updateRank(tree_[node].right_);
+      }
+      _updateRank(node);
+      if (_rank(node) == rank) {
+        return;
+      }
+    }
+  }
+
+  // Demotes up the path while node is a three child, ends with at most two
+  // rotations. Node may be empty, side is its side of the parent.
+  void _eraseFixWeak(const auto& path, std::size_t depth, size_type node,
+                     bool side) {
+    if (! depth) {
+      return;
+    }
+    size_type parent = path[--depth];
+    // Parent became a leaf of rank one
+    if (tree_[parent].left_ == empty_index_ &&
+        tree_[parent].right_ == empty_index_ && _rank(parent) == 1) {
+      --tree_[parent].rank_;
+      if (! depth) {
+        return;
+      }
+      node   = parent;
+      parent = path[--depth];
+      side   = (tree_[parent].right_ == node);
+    }
+    while (_rank(parent) - _rank(node) == 3) {
+      counters_.add(&FlatTreeStats::fixErase_);
+      size_type sibling = _child(parent, ! side);
+      size_type outer   = _child(sibling, ! side);
+      size_type inner   = _child(sibling, side);
+      if (_rank(parent) - _rank(sibling) == 2) {
+        --tree_[parent].rank_;
+      } else if (_rank(sibling) - _rank(outer) == 2 &&
+                 _rank(sibling) - _rank(inner) == 2) {
+        --tree_[parent].rank_;
+        --tree_[sibling].rank_;
+      } else {
+        if (_rank(sibling) - _rank(outer) == 1) {
+          // Sibling moves up into parent, parent into sibling
+          _rotate(parent, side);
+          ++tree_[parent].rank_;
+          --tree_[sibling].rank_;
+          if (tree_[sibling].left_ == empty_index_ &&
+              tree_[sibling].right_ == empty_index_) {
+            --tree_[sibling].rank_;
+          }
+        } else {
+          // Inner moves up into parent, sibling into inner, parent into
+          // sibling
+          _rotate(sibling, ! side);
+          _rotate(parent, side);
+          tree_[parent].rank_  = static_cast<std::uint8_t>(_rank(parent) + 2);
+          tree_[sibling].rank_ = static_cast<std::uint8_t>(_rank(sibling) - 2);
+          --tree_[inner].rank_;
+        }
+        return;
+      }
+      if (! depth) {
+        return;
+      }
+      node   = parent;
+      parent = path[--depth];
+      side   = (tree_[parent].right_ == node);
+    }
+  }
+
+  // Rank of an empty child is minus one
+  [[nodiscard]] int _rank(size_type node) const {
+    return (node == empty_index_) ? -1 : tree_[node].rank_;
+  }
+
+  void _updateRank(size_type node) {
+    if (node != empty_index_) {
+      tree_[node].rank_ = static_cast<std::uint8_t>(
+          1 + std::max(_rank(tree_[node].left_), _rank(tree_[node].right_)));
+    }
+  }
+
+  // Rotates and follows the pair in tracked to its new slot
+  void _rotateTracked(size_type node, bool dir, size_type& tracked) {
+    size_type child = _child(node, ! dir);
+    _rotate(node, dir);
+    tracked = (tracked == node) ? child : (tracked == child) ? node : tracked;
+  }
+
+  // Creates a red leaf in the end of the tree
+  template <typename... Args>
+  size_type _createNode(const key_type& key, [[maybe_unused]] size_type parent,
+                        Args&&... args) {
+    auto mark = counters_.now();
+    _resizeTree();
+    counters_.phase(FlatTreePhase::InsertResize, mark);
+    auto& newNodeRef        = tree_[size_];
+    newNodeRef.pair_.first  = key;
+    newNodeRef.pair_.second = mapped_type(std::forward<Args>(args)...);
+    if constexpr (PARENT_) {
+      newNodeRef.parent_ = parent;
+    }
+    newNodeRef.left_  = empty_index_;
+    newNodeRef.right_ = empty_index_;
+    if constexpr (RANK_) {
+      newNodeRef.rank_ = 0;
+    } else {
+      newNodeRef.color_ = RED_;
+    }
+    size_type index = size_++;
+    lookup_.insert(newNodeRef.pair_.first, index, tree_, size_);
+    digest_.touch(index);
+    counters_.phase(FlatTreePhase::InsertInit, mark);
+    return index;
+  }
+
+  // Key comparison, counted by dro::OperationStats
+  [[nodiscard]] bool _less(const key_type& lhs, const key_type& rhs) const {
+    counters_.add(&FlatTreeStats::comparisons_);
+    return key_compare()(lhs, rhs);
+  }
+
+  // Key equality of the search loops, counted with the ordering comparisons
+  [[nodiscard]] bool _equal(const key_type& lhs, const key_type& rhs) const {
+    counters_.add(&FlatTreeStats::comparisons_);
+    return lhs == rhs;
+  }
+
+  [[nodiscard]] bool _isRed(size_type node) const {
+    return node != empty_index_ && tree_[node].color_ == RED_;
+  }
+
+  size_type& _child(size_type node, bool right) {
+    return right ? tree_[node].right_ : tree_[node].left_;
+  }
+
+  size_type _child(size_type node, bool right) const {
+    return right ? tree_[node].right_ : tree_[node].left_;
+  }
+
+  // Lifts the child opposite of dir, as in _rotateLeft and _rotateRight
+  void _rotate(size_type node, bool dir) {
+    if (dir) {
+      _rotateRight(node);
+    } else {
+      _rotateLeft(node);
+    }
+  }
+
   // Overload For FlatSet
   template <typename... Args>
   std::pair<iterator, bool> _emplaceSet(Args&&... args)
@@ -641,15 +2703,17 @@ private:
   }
 
   std::pair<size_type, bool> _checkCachedExtrema(const key_type& key,
-                                                 size_type& extremaCase) {
+                                                 size_type& extremaCase) const {
     if (firstIndexCache_ != empty_index_ &&
-        key_compare()(key, tree_[firstIndexCache_].pair_.first)) {
+        _less(key, tree_[firstIndexCache_].pair_.first)) {
       extremaCase = 2;
+      counters_.add(&FlatTreeStats::extremaHits_);
       return {firstIndexCache_, true};
     }
     if (lastIndexCache_ != empty_index_ &&
-        key_compare()(tree_[lastIndexCache_].pair_.first, key)) {
+        _less(tree_[lastIndexCache_].pair_.first, key)) {
       extremaCase = 1;
+      counters_.add(&FlatTreeStats::extremaHits_);
       return {lastIndexCache_, true};
     }
     return {empty_index_, false};
@@ -665,18 +2729,21 @@ private:
     }
   }
 
-  std::pair<size_type, bool> _findInsertLocation(const key_type& key) {
+  // Const so the search reads the nodes without marking checkpoint chunks
+  std::pair<size_type, bool> _findInsertLocation(const key_type& key) const {
+    counters_.add(&FlatTreeStats::searches_);
     size_type node   = root_;
     size_type parent = empty_index_;
     while (node != empty_index_) {
-      parent          = node;
-      auto& parentRef = tree_[parent];
+      parent                = node;
+      const auto& parentRef = tree_[parent];
       _prefetchBinarySearch(parentRef);
+      counters_.add(&FlatTreeStats::depth_);
       // Key found
-      if (key == parentRef.pair_.first) {
+      if (_equal(key, parentRef.pair_.first)) {
         return {parent, false};
       }
-      bool compare = key_compare()(key, parentRef.pair_.first);
+      bool compare = _less(key, parentRef.pair_.first);
       node         = compare ? parentRef.left_ : parentRef.right_;
     }
     return {parent, true};
@@ -685,26 +2752,93 @@ private:
   void _insertUpdateParentRoot(const key_type& key, size_type parent,
                                size_type insertIndex) {
     auto& parentRef = tree_[parent];
-    if (key_compare()(key, parentRef.pair_.first)) {
+    if (_less(key, parentRef.pair_.first)) {
       parentRef.left_ = insertIndex;
     } else {
       parentRef.right_ = insertIndex;
     }
   }
 
+  // Track finds the next element for the returned iterator of erase,
+  // otherwise the second member is empty_index_
+  template <bool Track>
   std::pair<bool, size_type> _erase(const key_type& key,
                                     size_type index = empty_index_) {
-    size_type eraseIndex = (index == empty_index_) ? _findIndex(key) : index;
+    DRO_FLAT_PROBE(erase_entry, static_cast<std::uint64_t>(size_));
+    [[maybe_unused]] FlatTreeProbeMark probe = _probeMark();
+    if (undo_.logging()) {
+      size_type node = (index == empty_index_) ? _findIndex(key) : index;
+      if (node != empty_index_) {
+        undo_.log(FlatTreeUndo::Erase, tree_[node].pair_);
+      }
+    }
+    std::pair<bool, size_type> result;
+    if constexpr (tombstones_type::lazy_) {
+      result = _eraseLazy<Track>(key, index);
+    } else {
+      result = _eraseNode<Track>(key, index);
+    }
+    _digestFlush();
+    _topFlush();
+    DRO_FLAT_PROBE(erase_return, static_cast<std::uint64_t>(size_),
+                   result.first, _probeCount(probe, &FlatTreeStats::depth_),
+                   _probeCount(probe, &FlatTreeStats::rotations_));
+    return result;
+  }
+
+  // Marks a tombstone, the node stays in the tree until the batch removal
+  template <bool Track>
+  std::pair<bool, size_type> _eraseLazy(const key_type& key, size_type index) {
+    size_type node = (index == empty_index_) ? _findIndex(key) : index;
+    if (node == empty_index_) {
+      return {false, empty_index_};
+    }
+    tombstones_.mark(node);
+    digest_.touch(node);
+    if (! tombstones_.full(size_)) {
+      return {true, Track ? _nextLive(node) : empty_index_};
+    }
+    purge();
+    return {true, Track ? _upperBound(key) : empty_index_};
+  }
+
+  template <bool Track>
+  std::pair<bool, size_type> _eraseNode(const key_type& key,
+                                        size_type index = empty_index_) {
+    if constexpr (PARENT_) {
+      return _eraseBottomUp<Track>(key, index);
+    } else if constexpr (RANK_) {
+      return _eraseRank<Track>(key, index);
+    } else {
+      return _eraseTopDown<Track>(key, index);
+    }
+  }
+
+  template <bool Track>
+  std::pair<bool, size_type> _eraseBottomUp(const key_type& key,
+                                            size_type index) {
+    auto mark            = counters_.now();
+    size_type eraseIndex = (index == empty_index_) ? _findNode(key) : index;
+    counters_.phase(FlatTreePhase::EraseFind, mark);
     if (eraseIndex == empty_index_) {
       return {false, empty_index_};
     }
-    // For return iterator
-    size_type upperIndex    = _next(eraseIndex);
-    size_type lowerIndex    = _prev(eraseIndex);
-    const bool largestElem  = (upperIndex == empty_index_);
-    const bool smallestElem = (lowerIndex == empty_index_);
-    upperIndex              = largestElem ? size_ - 1 : upperIndex;
-    lowerIndex              = smallestElem ? size_ - 1 : lowerIndex;
+    lookup_.erase(tree_[eraseIndex].pair_.first, eraseIndex);
+    topCache_.touch(eraseIndex);
+    size_type upperIndex = empty_index_;
+    size_type lowerIndex = empty_index_;
+    bool largestElem     = (eraseIndex == lastIndexCache_);
+    bool smallestElem    = (eraseIndex == firstIndexCache_);
+    // For return iterator, erase by key skips both walks
+    if constexpr (Track) {
+      upperIndex   = _next(eraseIndex);
+      lowerIndex   = _prev(eraseIndex);
+      largestElem  = (upperIndex == empty_index_);
+      smallestElem = (lowerIndex == empty_index_);
+      upperIndex   = largestElem ? size_ - 1 : upperIndex;
+      lowerIndex   = smallestElem ? size_ - 1 : lowerIndex;
+    }
+    counters_.phase(FlatTreePhase::EraseNeighbors, mark);
     // Erase Node
     auto& eraseRef   = tree_[eraseIndex];
     bool color       = eraseRef.color_;
@@ -719,7 +2853,10 @@ private:
       }
       _updateParent(child, eraseRef.parent_);
       _updateParentChild(child, parent, eraseIndex);
-      _swapOutOfTree(child, eraseIndex, child, parent, upperIndex, lowerIndex);
+      counters_.phase(FlatTreePhase::EraseUnlink, mark);
+      _swapOutOfTree<Track>(child, eraseIndex, child, parent, upperIndex,
+                            lowerIndex);
+      counters_.phase(FlatTreePhase::EraseSwap, mark);
       // Both children full
     } else {
       size_type minNode = _minValueNode(eraseIndex);
@@ -738,30 +2875,229 @@ private:
       _updateParentChild(minNode, eraseRef.parent_, eraseIndex);
       tree_[eraseRef.left_].parent_ = minNode;
       _updateParent(eraseRef.right_, minNode);
-      _swapOutOfTree(minNode, eraseIndex, child, parent, upperIndex,
-                     lowerIndex);
+      counters_.phase(FlatTreePhase::EraseUnlink, mark);
+      _swapOutOfTree<Track>(minNode, eraseIndex, child, parent, upperIndex,
+                            lowerIndex);
+      counters_.phase(FlatTreePhase::EraseSwap, mark);
+    }
+    if (parent != empty_index_) {
+      digest_.touch(parent);
+    }
+    if (color == BLACK_) {
+      _fixErase<Track>(child, parent, upperIndex, lowerIndex);
+    }
+    counters_.phase(FlatTreePhase::EraseFix, mark);
+    --size_;
+    if constexpr (! Track) {
+      // Walks from the root only when an extremum was erased
+      firstIndexCache_ = smallestElem ? _extremum(false) : firstIndexCache_;
+      lastIndexCache_  = largestElem ? _extremum(true) : lastIndexCache_;
+      return {true, empty_index_};
+    }
+    upperIndex       = largestElem ? empty_index_ : upperIndex;
+    lowerIndex       = smallestElem ? empty_index_ : lowerIndex;
+    firstIndexCache_ = smallestElem ? upperIndex : firstIndexCache_;
+    lastIndexCache_  = largestElem ? lowerIndex : lastIndexCache_;
+    return {true, upperIndex};
+  }
+
+  // Single pass erase, pushes a red node down the search path so the leaf
+  // removed at the bottom is red or has a red child. A key with two children
+  // takes the pair of its in-order predecessor, which is removed instead.
+  template <bool Track>
+  std::pair<bool, size_type> _eraseTopDown(const key_type& key,
+                                           size_type index) {
+    if constexpr (lookup_type::exact_ || lookup_type::filter_) {
+      if (index == empty_index_ && _findNode(key) == empty_index_) {
+        return {false, empty_index_};
+      }
+    }
+    size_type parent = empty_index_;
+    size_type node   = empty_index_;
+    size_type found  = empty_index_;
+    size_type next   = root_;
+    bool dir         = true;
+    counters_.add(&FlatTreeStats::searches_);
+    while (next != empty_index_) {
+      counters_.add(&FlatTreeStats::depth_);
+      bool last = dir;
+      parent    = node;
+      node      = next;
+      dir       = _less(tree_[node].pair_.first, key);
+      if (_equal(tree_[node].pair_.first, key)) {
+        found = node;
+      }
+      if (! _isRed(node) && ! _isRed(_child(node, dir))) {
+        if (_isRed(_child(node, ! dir))) {
+          // Lift the red child, node moves down into its slot
+          size_type child = _child(node, ! dir);
+          _rotate(node, dir);
+          tree_[node].color_  = BLACK_;
+          tree_[child].color_ = RED_;
+          found               = (found == node) ? child : found;
+          parent              = node;
+          node                = child;
+        } else if (parent != empty_index_) {
+          size_type sibling = _child(parent, ! last);
+          if (sibling != empty_index_) {
+            if (! _isRed(tree_[sibling].left_) &&
+                ! _isRed(tree_[sibling].right_)) {
+              // Color flip
+              tree_[parent].color_  = BLACK_;
+              tree_[sibling].color_ = RED_;
+              tree_[node].color_    = RED_;
+            } else {
+              // Borrow from the sibling, parent moves down into its slot
+              if (_isRed(_child(sibling, last))) {
+                _rotate(sibling, ! last);
+              }
+              _rotate(parent, last);
+              tree_[node].color_                = RED_;
+              tree_[parent].color_              = RED_;
+              tree_[tree_[parent].left_].color_  = BLACK_;
+              tree_[tree_[parent].right_].color_ = BLACK_;
+              found  = (found == parent) ? sibling : found;
+              parent = sibling;
+            }
+          }
+        }
+      }
+      next = _child(node, dir);
+    }
+    if (found == empty_index_) {
+      if (root_ != empty_index_) {
+        tree_[root_].color_ = BLACK_;
+      }
+      return {false, empty_index_};
     }
-    if (color == BLACK_) {
-      _fixErase(child, parent, upperIndex, lowerIndex);
+    lookup_.erase(tree_[found].pair_.first, found);
+    topCache_.touch(found);
+    const bool smallestElem = (found == firstIndexCache_);
+    const bool largestElem  = (found == lastIndexCache_);
+    if (found != node) {
+      lookup_.relocate(tree_[node].pair_.first, node, found);
+      tombstones_.swap(node, found);
+      std::swap(tree_[found].pair_, tree_[node].pair_);
+      firstIndexCache_ = (firstIndexCache_ == node) ? found : firstIndexCache_;
+      lastIndexCache_  = (lastIndexCache_ == node) ? found : lastIndexCache_;
     }
-    upperIndex       = largestElem ? empty_index_ : upperIndex;
-    lowerIndex       = smallestElem ? empty_index_ : lowerIndex;
-    firstIndexCache_ = smallestElem ? upperIndex : firstIndexCache_;
-    lastIndexCache_  = largestElem ? lowerIndex : lastIndexCache_;
+    // Unlink the bottom node, it has at most one child
+    size_type child = (tree_[node].left_ == empty_index_) ? tree_[node].right_
+                                                          : tree_[node].left_;
+    if (parent == empty_index_) {
+      root_ = child;
+    } else {
+      _child(parent, tree_[parent].right_ == node) = child;
+    }
+    _fillSlot(node);
     --size_;
-    return {true, upperIndex};
+    if (root_ != empty_index_) {
+      tree_[root_].color_ = BLACK_;
+    }
+    if (smallestElem) {
+      firstIndexCache_ = _extremum(false);
+    }
+    if (largestElem) {
+      lastIndexCache_ = _extremum(true);
+    }
+    return {true, Track ? _upperBound(key) : empty_index_};
   }
 
-  size_type _findIndex(const key_type& key) const {
+  // Moves the last node into the empty slot, keeps the nodes in [0, size)
+  void _fillSlot(size_type slot) {
+    size_type last = size_ - 1;
+    if (slot == last) {
+      return;
+    }
+    counters_.add(&FlatTreeStats::relocations_);
+    // Without parent links, the parent is found by searching for the key
+    const key_type& lastKey = tree_[last].pair_.first;
+    size_type parent        = empty_index_;
+    size_type node          = root_;
+    while (node != last) {
+      parent = node;
+      node   = _child(node, _less(tree_[node].pair_.first, lastKey));
+    }
+    if (parent == empty_index_) {
+      root_ = slot;
+    } else {
+      _child(parent, tree_[parent].right_ == last) = slot;
+    }
+    _updateExtrema(last, slot);
+    lookup_.relocate(lastKey, last, slot);
+    tombstones_.swap(last, slot);
+    topCache_.touch(last);
+    std::swap(tree_[slot], tree_[last]);
+  }
+
+  size_type _extremum(bool right) {
     size_type node = root_;
+    if (node == empty_index_) {
+      return empty_index_;
+    }
+    while (_child(node, right) != empty_index_) { node = _child(node, right); }
+    return node;
+  }
+
+  size_type _findIndex(const key_type& key) const {
+    DRO_FLAT_PROBE(find_entry, static_cast<std::uint64_t>(size_));
+    [[maybe_unused]] FlatTreeProbeMark probe = _probeMark();
+    size_type node = _findNode(key);
+    if constexpr (tombstones_type::lazy_) {
+      if (node != empty_index_ && tombstones_.dead(node)) {
+        node = empty_index_;
+      }
+    }
+    DRO_FLAT_PROBE(find_return, node != empty_index_,
+                   _probeCount(probe, &FlatTreeStats::depth_));
+    return node;
+  }
+
+  // Counts of this thread at an entry probe, empty without the probes
+  [[nodiscard]] static FlatTreeProbeMark _probeMark() noexcept {
+#ifdef DRO_FLAT_PROBE_COUNTS
+    return flatTreeProbeCounts;
+#else
+    return {};
+#endif
+  }
+
+  // Count of the call since its entry probe, passed to the return probe
+  [[nodiscard]] static std::uint64_t
+  _probeCount([[maybe_unused]] const FlatTreeProbeMark& probe,
+              [[maybe_unused]] std::uint64_t FlatTreeStats::*counter) noexcept {
+#ifdef DRO_FLAT_PROBE_COUNTS
+    return flatTreeProbeCounts.*counter - probe.*counter;
+#else
+    return 0;
+#endif
+  }
+
+  // Includes the nodes with a tombstone
+  size_type _findNode(const key_type& key) const {
+    if constexpr (lookup_type::exact_) {
+      return lookup_.find(key, tree_);
+    }
+    if constexpr (lookup_type::filter_) {
+      if (! lookup_.mayContain(key)) {
+        return empty_index_;
+      }
+    }
+    counters_.add(&FlatTreeStats::searches_);
+    size_type node     = root_;
+    size_type lastNode = empty_index_;
+    if (_topSearch<false>(key, node, lastNode)) {
+      return node;
+    }
     // Find node with binary search
     while (node != empty_index_) {
       auto& nodeRef = tree_[node];
       _prefetchBinarySearch(nodeRef);
-      if (nodeRef.pair_.first == key) {
+      counters_.add(&FlatTreeStats::depth_);
+      if (_equal(nodeRef.pair_.first, key)) {
         return node;
       }
-      bool compare = key_compare()(nodeRef.pair_.first, key);
+      bool compare = _less(nodeRef.pair_.first, key);
       node         = compare ? nodeRef.right_ : nodeRef.left_;
     }
     return empty_index_;
@@ -783,14 +3119,19 @@ private:
   }
 
   size_type _upperBound(const key_type& key) const {
+    counters_.add(&FlatTreeStats::searches_);
     size_type node     = root_;
     size_type lastNode = empty_index_;
+    if (_topSearch<true>(key, node, lastNode)) {
+      return lastNode;
+    }
     // Find node with binary search
     while (node != empty_index_) {
       auto& nodeRef = tree_[node];
       _prefetchBinarySearch(nodeRef);
-      bool compare = (key_compare()(nodeRef.pair_.first, key) ||
-                      nodeRef.pair_.first == key);
+      counters_.add(&FlatTreeStats::depth_);
+      bool compare = (_less(nodeRef.pair_.first, key) ||
+                      _equal(nodeRef.pair_.first, key));
       lastNode     = compare ? lastNode : node;
       node         = compare ? nodeRef.right_ : nodeRef.left_;
     }
@@ -798,22 +3139,41 @@ private:
   }
 
   size_type _lowerBound(const key_type& key) const {
+    counters_.add(&FlatTreeStats::searches_);
     size_type node     = root_;
     size_type lastNode = empty_index_;
+    if (_topSearch<false>(key, node, lastNode)) {
+      return (node != empty_index_) ? node : lastNode;
+    }
     // Find node with binary search
     while (node != empty_index_) {
       auto& nodeRef = tree_[node];
       _prefetchBinarySearch(nodeRef);
-      if (nodeRef.pair_.first == key) {
+      counters_.add(&FlatTreeStats::depth_);
+      if (_equal(nodeRef.pair_.first, key)) {
         return node;
       }
-      bool compare = key_compare()(nodeRef.pair_.first, key);
+      bool compare = _less(nodeRef.pair_.first, key);
       lastNode     = compare ? lastNode : node;
       node         = compare ? nodeRef.right_ : nodeRef.left_;
     }
     return lastNode;
   }
 
+  // Last node with a key less than key, the backtrack of _prev without
+  // parent links
+  size_type _predecessor(const key_type& key) const {
+    size_type node     = root_;
+    size_type lastNode = empty_index_;
+    while (node != empty_index_) {
+      auto& nodeRef = tree_[node];
+      bool compare  = _less(nodeRef.pair_.first, key);
+      lastNode      = compare ? node : lastNode;
+      node          = compare ? nodeRef.right_ : nodeRef.left_;
+    }
+    return lastNode;
+  }
+
   void _transferData(size_type nodeLeft, size_type nodeRight) {
     auto& nodeLeftRef   = tree_[nodeLeft];
     auto& nodeRightRef  = tree_[nodeRight];
@@ -838,8 +3198,11 @@ private:
   }
 
   size_type _fixInsert(size_type node, const key_type& key) {
+    DRO_FLAT_PROBE(fix_insert_entry, static_cast<std::uint64_t>(node));
+    [[maybe_unused]] FlatTreeProbeMark probe = _probeMark();
     size_type baseNode = node;
     while (node != root_ && tree_[tree_[node].parent_].color_ == RED_) {
+      counters_.add(&FlatTreeStats::fixInsert_);
       size_type parent      = tree_[node].parent_;
       auto& parentRef       = tree_[parent];
       size_type grandparent = parentRef.parent_;
@@ -871,13 +3234,15 @@ private:
           _rotateLeft(grandparent);
         }
         std::swap(parentRef.color_, grandparentRef.color_);
-        if (tree_[grandparent].pair_.first == key) {
+        if (_equal(tree_[grandparent].pair_.first, key)) {
           baseNode = grandparent;
         }
         node = parent;
       }
     }
     tree_[root_].color_ = BLACK_;
+    DRO_FLAT_PROBE(fix_insert_return, static_cast<std::uint64_t>(baseNode),
+                   _probeCount(probe, &FlatTreeStats::rotations_));
     return baseNode;
   }
 
@@ -888,25 +3253,32 @@ private:
     uncleRef.color_       = BLACK_;
   }
 
+  // Track follows upperIndex and lowerIndex through the rotations
+  template <bool Track>
   void _fixErase(size_type node, size_type parent, size_type& upperIndex,
                  size_type& lowerIndex) {
     // Cannot be a reference
-    key_type upperKey = tree_[upperIndex].pair_.first;
-    key_type lowerKey = tree_[lowerIndex].pair_.first;
+    auto upperKey     = _trackedKey<Track>(upperIndex);
+    auto lowerKey     = _trackedKey<Track>(lowerIndex);
     size_type sibling = empty_index_;
     while (node != root_ &&
            (node == empty_index_ || tree_[node].color_ == BLACK_)) {
+      counters_.add(&FlatTreeStats::fixErase_);
       auto& nodeRef   = tree_[node];
       auto& parentRef = tree_[parent];
       bool isLeftTree = (node == parentRef.left_);
       // Analyze Sibling
       sibling = (isLeftTree) ? parentRef.right_ : parentRef.left_;
       _checkSiblingRed(sibling, parent, isLeftTree);
-      if (parent != empty_index_ && tree_[parent].pair_.first == upperKey) {
-        upperIndex = parent;
-      }
-      if (parent != empty_index_ && tree_[parent].pair_.first == lowerKey) {
-        lowerIndex = parent;
+      if constexpr (Track) {
+        if (parent != empty_index_ &&
+            _equal(tree_[parent].pair_.first, upperKey)) {
+          upperIndex = parent;
+        }
+        if (parent != empty_index_ &&
+            _equal(tree_[parent].pair_.first, lowerKey)) {
+          lowerIndex = parent;
+        }
       }
       auto& siblingRef = tree_[sibling];
       if (_checkSiblingChildColor(siblingRef, node, parent)) {
@@ -919,11 +3291,15 @@ private:
           _fixEraseRightTree(siblingRef, sibling, parent);
           _rotateRight(parent);
         }
-        if (sibling != empty_index_ && tree_[sibling].pair_.first == upperKey) {
-          upperIndex = sibling;
-        }
-        if (sibling != empty_index_ && tree_[sibling].pair_.first == lowerKey) {
-          lowerIndex = sibling;
+        if constexpr (Track) {
+          if (sibling != empty_index_ &&
+              _equal(tree_[sibling].pair_.first, upperKey)) {
+            upperIndex = sibling;
+          }
+          if (sibling != empty_index_ &&
+              _equal(tree_[sibling].pair_.first, lowerKey)) {
+            lowerIndex = sibling;
+          }
         }
         node = root_;
         break;
@@ -934,6 +3310,15 @@ private:
     }
   }
 
+  // Copy of the key at index, nothing to copy when untracked
+  template <bool Track> auto _trackedKey(size_type index) const {
+    if constexpr (Track) {
+      return tree_[index].pair_.first;
+    } else {
+      return false;
+    }
+  }
+
   void _checkSiblingRed(size_type& sibling, size_type& parent,
                         bool isLeftTree) {
     if (tree_[sibling].color_ == RED_) {
@@ -1000,24 +3385,36 @@ private:
   }
 
   size_type _rotateLeft(size_type node) {
+    counters_.add(&FlatTreeStats::rotations_);
     auto& nodeRef   = tree_[node];
     size_type child = nodeRef.right_;
     auto& childRef  = tree_[child];
     // Update Cached Extrema
     _updateExtrema(node, child);
-    // Update Children
-    size_type childRight = childRef.right_;
-    if (childRight != empty_index_) {
-      tree_[childRight].parent_ = node;
-    }
-    // Update Parent
-    size_type nodeLeft = nodeRef.left_;
-    if (nodeLeft != empty_index_) {
-      tree_[nodeLeft].parent_ = child;
+    if constexpr (PARENT_) {
+      // Update Children
+      size_type childRight = childRef.right_;
+      if (childRight != empty_index_) {
+        tree_[childRight].parent_ = node;
+      }
+      // Update Parent
+      size_type nodeLeft = nodeRef.left_;
+      if (nodeLeft != empty_index_) {
+        tree_[nodeLeft].parent_ = child;
+      }
     }
     // Touches less memory, more code, but less computation
+    lookup_.swap(nodeRef.pair_.first, node, childRef.pair_.first, child);
+    tombstones_.swap(node, child);
+    // The subtree of node keeps its elements, the subtree of child does not
+    digest_.touch(child);
+    topCache_.touch(node);
     std::swap(nodeRef.pair_, childRef.pair_);
-    std::swap(nodeRef.color_, childRef.color_);
+    if constexpr (RANK_) {
+      std::swap(nodeRef.rank_, childRef.rank_);
+    } else {
+      std::swap(nodeRef.color_, childRef.color_);
+    }
     std::swap(nodeRef.left_, childRef.right_);
     std::swap(nodeRef.left_, nodeRef.right_);
     std::swap(childRef.left_, childRef.right_);
@@ -1025,24 +3422,36 @@ private:
   }
 
   size_type _rotateRight(size_type node) {
+    counters_.add(&FlatTreeStats::rotations_);
     auto& nodeRef   = tree_[node];
     size_type child = tree_[node].left_;
     auto& childRef  = tree_[child];
     // Update Cached Extrema
     _updateExtrema(node, child);
-    // Update Children
-    size_type childLeft = childRef.left_;
-    if (childLeft != empty_index_) {
-      tree_[childLeft].parent_ = node;
-    }
-    // Update Parent
-    size_type nodeRight = nodeRef.right_;
-    if (nodeRight != empty_index_) {
-      tree_[nodeRight].parent_ = child;
+    if constexpr (PARENT_) {
+      // Update Children
+      size_type childLeft = childRef.left_;
+      if (childLeft != empty_index_) {
+        tree_[childLeft].parent_ = node;
+      }
+      // Update Parent
+      size_type nodeRight = nodeRef.right_;
+      if (nodeRight != empty_index_) {
+        tree_[nodeRight].parent_ = child;
+      }
     }
     // Touches less memory, more code, but less computation
+    lookup_.swap(nodeRef.pair_.first, node, childRef.pair_.first, child);
+    tombstones_.swap(node, child);
+    // The subtree of node keeps its elements, the subtree of child does not
+    digest_.touch(child);
+    topCache_.touch(node);
     std::swap(nodeRef.pair_, childRef.pair_);
-    std::swap(nodeRef.color_, childRef.color_);
+    if constexpr (RANK_) {
+      std::swap(nodeRef.rank_, childRef.rank_);
+    } else {
+      std::swap(nodeRef.color_, childRef.color_);
+    }
     std::swap(nodeRef.right_, childRef.left_);
     std::swap(nodeRef.left_, nodeRef.right_);
     std::swap(childRef.left_, childRef.right_);
@@ -1066,6 +3475,7 @@ private:
     if (nodeA == nodeB) {
       return;
     }
+    counters_.add(&FlatTreeStats::relocations_);
     _updateExtrema(nodeA, nodeB);
     // Saves computation time (~3-4 nanoseconds)
     auto& nodeARef        = tree_[nodeA];
@@ -1120,34 +3530,44 @@ private:
     // Update Root if in swap
     root_ = (root_ == nodeA) ? nodeB : (root_ == nodeB) ? nodeA : root_;
     // Swap vector position
+    lookup_.swap(nodeARef.pair_.first, nodeA, nodeBRef.pair_.first, nodeB);
+    tombstones_.swap(nodeA, nodeB);
+    digest_.swap(nodeA, nodeB);
+    topCache_.touch(nodeA);
+    topCache_.touch(nodeB);
     std::swap(nodeARef, nodeBRef);
   }
 
+  template <bool Track>
   void _swapOutOfTree(size_type node, size_type removeNode, size_type& child,
                       size_type& parent, size_type& upperIndex,
                       size_type& lowerIndex) {
     if (node != empty_index_) {
-      _swapNodePositionRemove(node, removeNode, child, parent, upperIndex,
-                              lowerIndex);
+      _swapNodePositionRemove<Track>(node, removeNode, child, parent,
+                                     upperIndex, lowerIndex);
       removeNode = node;
     }
-    _swapNodePositionRemove(size_ - 1, removeNode, child, parent, upperIndex,
-                            lowerIndex);
+    _swapNodePositionRemove<Track>(size_ - 1, removeNode, child, parent,
+                                   upperIndex, lowerIndex);
   }
 
+  template <bool Track>
   void _swapNodePositionRemove(size_type nodeA, size_type nodeB,
                                size_type& child, size_type& parent,
                                size_type& upperIndex, size_type& lowerIndex) {
     if (nodeA == nodeB) {
       return;
     }
+    counters_.add(&FlatTreeStats::relocations_);
     _updateExtrema(nodeA, nodeB);
     // Update upperIndex for return iterator
-    if (tree_[nodeA].pair_.first == tree_[upperIndex].pair_.first) {
-      upperIndex = nodeB;
-    }
-    if (tree_[nodeA].pair_.first == tree_[lowerIndex].pair_.first) {
-      lowerIndex = nodeB;
+    if constexpr (Track) {
+      if (_equal(tree_[nodeA].pair_.first, tree_[upperIndex].pair_.first)) {
+        upperIndex = nodeB;
+      }
+      if (_equal(tree_[nodeA].pair_.first, tree_[lowerIndex].pair_.first)) {
+        lowerIndex = nodeB;
+      }
     }
     // Update child and parent index for erase method
     if (nodeA == child) {
@@ -1181,7 +3601,12 @@ private:
     }
     // Update Root if in swap
     root_ = (root_ == nodeA) ? nodeB : root_;
-    // Swap vector position
+    // Swap vector position, nodeB holds the erased pair
+    lookup_.relocate(nodeARef.pair_.first, nodeA, nodeB);
+    tombstones_.swap(nodeA, nodeB);
+    digest_.swap(nodeA, nodeB);
+    topCache_.touch(nodeA);
+    topCache_.touch(nodeB);
     std::swap(nodeARef, tree_[nodeB]);
   }
 
@@ -1192,52 +3617,538 @@ private:
     return node;
   }
 
-  size_type _first() const { return firstIndexCache_; }
+  size_type _first() const { return _skipDead(firstIndexCache_); }
 
-  size_type _last() const { return lastIndexCache_; }
+  size_type _last() const {
+    if constexpr (tombstones_type::lazy_) {
+      if (lastIndexCache_ != empty_index_ &&
+          tombstones_.dead(lastIndexCache_)) {
+        return _prevLive(lastIndexCache_);
+      }
+    }
+    return lastIndexCache_;
+  }
 
-  size_type _next(size_type node) const {
+  // In order visit of the live pairs of the subtree with keys in [low, high),
+  // a null bound is open. The path is kept on a stack, no parent walks.
+  void _exportRange(size_type node, const key_type* low, const key_type* high,
+                    const auto& visit) const {
+    std::array<size_type, max_depth_> path;
+    std::size_t depth {};
+    while (true) {
+      while (node != empty_index_) {
+        const auto& nodeRef = tree_[node];
+        // The node and its left subtree are below the range
+        if (low && _less(nodeRef.pair_.first, *low)) {
+          node = nodeRef.right_;
+          continue;
+        }
+        path[depth++] = node;
+        node          = nodeRef.left_;
+      }
+      if (! depth) {
+        return;
+      }
+      node                = path[--depth];
+      const auto& nodeRef = tree_[node];
+      if (high && ! _less(nodeRef.pair_.first, *high)) {
+        return;
+      }
+      if (! tombstones_.dead(node)) {
+        visit(nodeRef.pair_);
+      }
+      node = nodeRef.right_;
+    }
+  }
+
+  // Splits the subtree into the subtrees at levels deep, in key order
+  void _exportParts(size_type node, int levels,
+                    std::vector<std::pair<size_type, bool>>& parts) const {
     if (node == empty_index_) {
-      return empty_index_;
+      return;
     }
-    if (tree_[node].right_ != empty_index_) {
-      node           = tree_[node].right_;
-      size_type left = empty_index_;
-      while ((left = tree_[node].left_) != empty_index_) { node = left; }
-      return node;
+    if (! levels) {
+      parts.emplace_back(node, true);
+      return;
     }
-    // If no right child then backtrack
-    size_type parent = empty_index_;
-    while ((parent = tree_[node].parent_) && parent != empty_index_ &&
-           node == tree_[parent].right_) {
-      node = parent;
+    _exportParts(tree_[node].left_, levels - 1, parts);
+    parts.emplace_back(node, false);
+    _exportParts(tree_[node].right_, levels - 1, parts);
+  }
+
+  // Exported element, the key alone for a set
+  static const export_type& _exportElement(const value_type& pair) noexcept {
+    if constexpr (std::is_same_v<mapped_type, FlatSetEmptyType>) {
+      return pair.first;
+    } else {
+      return pair;
     }
-    if (parent == root_ && node == tree_[parent].right_) {
-      return empty_index_;
+  }
+
+  // First node from node onwards without a tombstone
+  size_type _skipDead(size_type node) const {
+    if constexpr (tombstones_type::lazy_) {
+      if (node != empty_index_ && tombstones_.dead(node)) {
+        return _nextLive(node);
+      }
+    }
+    return node;
+  }
+
+  size_type _nextLive(size_type node) const {
+    node = _next(node);
+    if constexpr (tombstones_type::lazy_) {
+      while (node != empty_index_ && tombstones_.dead(node)) {
+        node = _next(node);
+      }
+    }
+    return node;
+  }
+
+  size_type _nextLive(size_type node, path_type& path) const {
+    node = _next(node, path);
+    if constexpr (tombstones_type::lazy_) {
+      while (node != empty_index_ && tombstones_.dead(node)) {
+        node = _next(node, path);
+      }
+    }
+    return node;
+  }
+
+  size_type _prevLive(size_type node) const {
+    node = _prev(node);
+    if constexpr (tombstones_type::lazy_) {
+      while (node != empty_index_ && tombstones_.dead(node)) {
+        node = _prev(node);
+      }
+    }
+    return node;
+  }
+
+  size_type _prevLive(size_type node, path_type& path) const {
+    node = _prev(node, path);
+    if constexpr (tombstones_type::lazy_) {
+      while (node != empty_index_ && tombstones_.dead(node)) {
+        node = _prev(node, path);
+      }
+    }
+    return node;
+  }
+
+  // A single step without an iterator searches from the root when the tree
+  // has no parent links, no path to allocate
+  size_type _next(size_type node) const {
+    if constexpr (! PARENT_) {
+      return (node == empty_index_) ? empty_index_
+                                    : _upperBound(tree_[node].pair_.first);
+    } else {
+      path_type path;
+      return _step(node, path, true);
     }
-    return parent;
   }
 
   size_type _prev(size_type node) const {
+    if constexpr (! PARENT_) {
+      return (node == empty_index_) ? empty_index_
+                                    : _predecessor(tree_[node].pair_.first);
+    } else {
+      path_type path;
+      return _step(node, path, false);
+    }
+  }
+
+  size_type _next(size_type node, path_type& path) const {
+    return _step(node, path, true);
+  }
+
+  size_type _prev(size_type node, path_type& path) const {
+    return _step(node, path, false);
+  }
+
+  // In order successor, or predecessor when right is false
+  size_type _step(size_type node, [[maybe_unused]] path_type& path,
+                  bool right) const {
     if (node == empty_index_) {
       return empty_index_;
     }
-    if (tree_[node].left_ != empty_index_) {
-      node            = tree_[node].left_;
-      size_type right = empty_index_;
-      while ((right = tree_[node].right_) != empty_index_) { node = right; }
-      return node;
+    if constexpr (! PARENT_) {
+      if (! path.valid_) {
+        _fillPath(node, path);
+      }
     }
-    // If no left child then backtrack
-    size_type parent = empty_index_;
-    while ((parent = tree_[node].parent_) && parent != empty_index_ &&
-           node == tree_[parent].left_) {
-      node = parent;
+    if (_child(node, right) != empty_index_) {
+      if constexpr (! PARENT_) {
+        path.nodes_.push_back(node);
+      }
+      node            = _child(node, right);
+      size_type child = empty_index_;
+      while ((child = _child(node, ! right)) != empty_index_) {
+        if constexpr (! PARENT_) {
+          path.nodes_.push_back(node);
+        }
+        node = child;
+      }
+      return node;
     }
-    if (parent == root_ && node == tree_[parent].left_) {
+    if constexpr (! PARENT_) {
+      // Pop until the node is in the subtree on the other side
+      while (! path.nodes_.empty()) {
+        size_type parent = path.nodes_.back();
+        path.nodes_.pop_back();
+        if (_child(parent, ! right) == node) {
+          return parent;
+        }
+        node = parent;
+      }
+      path.valid_ = false;
       return empty_index_;
+    } else {
+      // If no child then backtrack
+      size_type parent = empty_index_;
+      while ((parent = tree_[node].parent_) && parent != empty_index_ &&
+             node == _child(parent, right)) {
+        node = parent;
+      }
+      if (parent == root_ && node == _child(parent, right)) {
+        return empty_index_;
+      }
+      return parent;
+    }
+  }
+
+  // Searches the ancestors of the node once per iterator, reserved for the
+  // deepest red black or weak AVL tree of this size
+  void _fillPath(size_type node, path_type& path) const {
+    const key_type& key = tree_[node].pair_.first;
+    path.valid_         = true;
+    path.nodes_.clear();
+    path.nodes_.reserve(
+        2 * std::bit_width(static_cast<std::size_t>(size_)) + 2);
+    for (size_type current = root_; current != node;) {
+      path.nodes_.push_back(current);
+      current = _child(current, _less(tree_[current].pair_.first, key));
+    }
+  }
+
+  // Hash of a key for the layout dump, zero for keys without std::hash
+  [[nodiscard]] static std::uint64_t _layoutDigest(const key_type& key) {
+    if constexpr (requires { std::hash<key_type> {}(key); }) {
+      // Fibonacci mixing, std::hash is the identity for integers
+      return static_cast<std::uint64_t>(std::hash<key_type> {}(key)) *
+             0x9E3779B97F4A7C15ULL;
+    } else {
+      return 0;
+    }
+  }
+
+  // Cache line or page of the node at slot, by its address
+  [[nodiscard]] std::uintptr_t _layoutBlock(size_type slot,
+                                            std::size_t block) const {
+    return reinterpret_cast<std::uintptr_t>(&tree_[slot]) / block;
+  }
+
+  // Top Cache
+  // First levels of a search on the cached keys, lastNode is the last node
+  // the search went left at. Returns true when the search ends inside the
+  // cache, with node at an equal key unless Upper, or empty at an empty
+  // subtree. Otherwise node is the slot below the cache to go on from.
+  template <bool Upper>
+  bool _topSearch(const key_type& key, size_type& node,
+                  size_type& lastNode) const {
+    if constexpr (top_type::cached_) {
+      if (topCache_.stale_) {
+        return false;
+      }
+      std::size_t pos {};
+      while (pos < top_type::inner_) {
+        const auto& entry = topCache_.entries_[pos];
+        if (entry.node_ == empty_index_) {
+          node = empty_index_;
+          return true;
+        }
+        counters_.add(&FlatTreeStats::depth_);
+        if (! Upper && _equal(entry.key_, key)) {
+          node = entry.node_;
+          return true;
+        }
+        bool compare = _less(entry.key_, key) ||
+                       (Upper && _equal(entry.key_, key));
+        lastNode     = compare ? lastNode : entry.node_;
+        pos          = 2 * pos + 1 + compare;
+      }
+      node = topCache_.frontier_[pos - top_type::inner_];
+    }
+    return false;
+  }
+
+  // Builds the cache again after a change reached a cached slot
+  void _topFlush() {
+    if constexpr (top_type::cached_) {
+      if (topCache_.stale_ && size_ >= top_type::threshold_) {
+        _topBuild();
+      }
+    }
+  }
+
+  // Copies the top levels breadth first and marks their slots
+  void _topBuild() {
+    auto& cache = topCache_;
+    for (const auto& entry : cache.entries_) {
+      if (entry.node_ != empty_index_) {
+        cache.top_[entry.node_] = false;
+      }
+    }
+    for (size_type node : cache.frontier_) {
+      if (node != empty_index_) {
+        cache.top_[node] = false;
+      }
+    }
+    cache.top_.resize(size_);
+    cache.entries_.assign(top_type::inner_, {key_type {}, empty_index_});
+    cache.frontier_.assign(top_type::inner_ + 1, empty_index_);
+    cache.entries_[0].node_ = root_;
+    // Breadth first, the children of pos are 2 * pos + 1 and 2 * pos + 2
+    for (std::size_t pos {}; pos < top_type::inner_; ++pos) {
+      size_type node = cache.entries_[pos].node_;
+      if (node == empty_index_) {
+        continue;
+      }
+      const auto& nodeRef      = tree_[node];
+      cache.entries_[pos].key_ = nodeRef.pair_.first;
+      cache.top_[node]         = true;
+      for (bool right : {false, true}) {
+        std::size_t child   = 2 * pos + 1 + right;
+        size_type childNode = right ? nodeRef.right_ : nodeRef.left_;
+        if (child < top_type::inner_) {
+          cache.entries_[child].node_ = childNode;
+        } else {
+          cache.frontier_[child - top_type::inner_] = childNode;
+          if (childNode != empty_index_) {
+            cache.top_[childNode] = true;
+          }
+        }
+      }
+    }
+    cache.stale_ = false;
+  }
+
+  // Sums the queued slots again, the walks up to the root leave every
+  // ancestor of a changed subtree correct whatever the queue order
+  void _digestFlush() const {
+    if constexpr (digest_type::merkle_) {
+      if (! digest_.rebuild_) {
+        for (std::size_t index : digest_.dirty_) {
+          if (index < size_) {
+            _digestWalk(static_cast<size_type>(index));
+          }
+        }
+      }
+      digest_.dirty_.clear();
+    }
+  }
+
+  // Picks up the values assigned through references from at and operator[]
+  void _digestRefresh() const {
+    if (digest_.rebuild_) {
+      digest_.sums_.resize(size_);
+      _digestBuild(root_);
+      digest_.rebuild_ = false;
+    }
+    for (const auto& key : digest_.stale_) {
+      size_type node = _findNode(key);
+      if (node != empty_index_) {
+        _digestWalk(node);
+      }
+    }
+    digest_.stale_.clear();
+  }
+
+  void _digestWalk(size_type node) const {
+    for (; node != empty_index_; node = tree_[node].parent_) {
+      _digestSum(node);
+    }
+  }
+
+  std::uint64_t _digestBuild(size_type node) const {
+    if (node == empty_index_) {
+      return 0;
+    }
+    _digestBuild(tree_[node].left_);
+    _digestBuild(tree_[node].right_);
+    return _digestSum(node);
+  }
+
+  std::uint64_t _digestSum(size_type node) const {
+    const auto& nodeRef = tree_[node];
+    std::uint64_t sum   = _digestElement(node);
+    if (nodeRef.left_ != empty_index_) {
+      sum += digest_.sums_[nodeRef.left_];
+    }
+    if (nodeRef.right_ != empty_index_) {
+      sum += digest_.sums_[nodeRef.right_];
+    }
+    return digest_.sums_[node] = sum;
+  }
+
+  // A tombstone hashes to zero, the key is absent
+  std::uint64_t _digestElement(size_type node) const {
+    if (node == empty_index_ || tombstones_.dead(node)) {
+      return 0;
+    }
+    return digest_type::hash(tree_[node].pair_);
+  }
+
+  // Sum of the element hashes of the keys less than key, and the hash of
+  // key itself or zero if absent, in one descent
+  std::pair<std::uint64_t, std::uint64_t>
+  _digestSplit(const key_type& key) const {
+    std::uint64_t sum {};
+    size_type node = root_;
+    while (node != empty_index_) {
+      const auto& nodeRef = tree_[node];
+      bool less           = _less(nodeRef.pair_.first, key);
+      if (! less && _less(key, nodeRef.pair_.first)) {
+        node = nodeRef.left_;
+        continue;
+      }
+      if (nodeRef.left_ != empty_index_) {
+        sum += digest_.sums_[nodeRef.left_];
+      }
+      if (! less) {
+        return {sum, _digestElement(node)};
+      }
+      sum  += _digestElement(node);
+      node  = nodeRef.right_;
     }
-    return parent;
+    return {sum, 0};
+  }
+
+  std::uint64_t _digestRoot() const {
+    return (root_ == empty_index_) ? 0 : digest_.sums_[root_];
+  }
+
+  // Keys strictly between low and high, a null bound is unbounded. The sums
+  // of other below the bounds come down from the parent, so a visited node
+  // costs one descent of other.
+  void _diff(const self_type& other, size_type node, const key_type* low,
+             const key_type* high, std::uint64_t lowSum,
+             std::uint64_t highSum, std::vector<key_type>& keys) const {
+    std::uint64_t sum = (node == empty_index_) ? 0 : digest_.sums_[node];
+    if (sum == highSum - lowSum) {
+      return;
+    }
+    if (node == empty_index_) {
+      // Every key of other in the range is missing here
+      size_type index =
+          low ? other._skipDead(other._upperBound(*low)) : other._first();
+      for (; index != empty_index_ &&
+             (! high || _less(other.tree_[index].pair_.first, *high));
+           index = other._nextLive(index)) {
+        keys.push_back(other.tree_[index].pair_.first);
+      }
+      return;
+    }
+    const auto& nodeRef   = tree_[node];
+    const key_type& key   = nodeRef.pair_.first;
+    auto [below, element] = other._digestSplit(key);
+    _diff(other, nodeRef.left_, low, &key, lowSum, below, keys);
+    if (_digestElement(node) != element) {
+      keys.push_back(key);
+    }
+    _diff(other, nodeRef.right_, &key, high, below + element, highSum, keys);
+  }
+
+  // Chunk and manifest records of a checkpoint, marks every chunk clean
+  std::vector<char> _checkpointRecords(bool full) {
+    static_assert(std::is_trivially_copyable_v<key_type> &&
+                      std::is_trivially_copyable_v<mapped_type>,
+                  "Checkpoints copy the node bytes");
+    using record_type = FlatTreeCheckpointRecord;
+    constexpr std::size_t chunkNodes = storage_type::chunk_;
+    purge();
+    std::size_t chunks = (size_ + chunkNodes - 1) / chunkNodes;
+    std::vector<char> records;
+    auto append = [&records](const void* data, std::size_t bytes) {
+      std::size_t offset = records.size();
+      records.resize(offset + bytes);
+      std::memcpy(records.data() + offset, data, bytes);
+    };
+    record_type record;
+    record.nodeBytes_  = sizeof(node_type);
+    record.chunkNodes_ = chunkNodes;
+    for (std::size_t chunk {}; chunk < chunks; ++chunk) {
+      if (! full && ! tree_.dirty(chunk)) {
+        continue;
+      }
+      std::size_t first = chunk * chunkNodes;
+      record.kind_      = record_type::chunk_;
+      record.index_     = chunk;
+      record.count_     = std::min<std::size_t>(chunkNodes, size_ - first);
+      append(&record, sizeof(record));
+      append(tree_.data() + first, record.count_ * sizeof(node_type));
+    }
+    record.kind_  = record_type::manifest_;
+    record.index_ = size_;
+    record.count_ = root_;
+    record.first_ = firstIndexCache_;
+    record.last_  = lastIndexCache_;
+    append(&record, sizeof(record));
+    tree_.clean(chunks);
+    return records;
+  }
+
+  static void _writeCheckpoint(int fd, const std::vector<char>& records) {
+    std::size_t written {};
+    while (written < records.size()) {
+      ssize_t result =
+          ::write(fd, records.data() + written, records.size() - written);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result < 0) {
+        throw std::runtime_error("dro::FlatRBTree::checkpoint");
+      }
+      written += static_cast<std::size_t>(result);
+    }
+    if (::fsync(fd) != 0) {
+      throw std::runtime_error("dro::FlatRBTree::checkpoint");
+    }
+  }
+
+  // Size within the saved nodes, root and extrema within the size or all
+  // empty for an empty tree
+  static bool _validManifest(const FlatTreeCheckpointRecord& manifest,
+                             std::size_t nodes) {
+    auto empty = static_cast<std::uint64_t>(empty_index_);
+    if (manifest.index_ > nodes) {
+      return false;
+    }
+    if (manifest.index_ == 0) {
+      return manifest.count_ == empty && manifest.first_ == empty &&
+             manifest.last_ == empty;
+    }
+    return manifest.count_ < manifest.index_ &&
+           manifest.first_ < manifest.index_ &&
+           manifest.last_ < manifest.index_;
+  }
+
+  // False at the end of the file or on a short read
+  static bool _readCheckpoint(int fd, void* data, std::size_t bytes,
+                              off_t& offset) {
+    auto* out = static_cast<char*>(data);
+    std::size_t done {};
+    while (done < bytes) {
+      ssize_t result = ::pread(fd, out + done, bytes - done, offset);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        return false;
+      }
+      done += static_cast<std::size_t>(result);
+      offset += result;
+    }
+    return true;
   }
 
   void _validateSize() {
@@ -1249,12 +4160,19 @@ private:
 
   void _resizeTree(size_type new_cap = 0) {
     if (new_cap > capacity_) {
-      tree_.resize(new_cap);
+      counters_.add(&FlatTreeStats::resizes_);
+      DRO_FLAT_PROBE(resize_entry, static_cast<std::uint64_t>(capacity_));
+      capacity_ = new_cap;
+      tree_.resize(capacity_);
+      DRO_FLAT_PROBE(resize_return, static_cast<std::uint64_t>(capacity_));
       return;
     }
     if (size_ == capacity_) {
+      counters_.add(&FlatTreeStats::resizes_);
+      DRO_FLAT_PROBE(resize_entry, static_cast<std::uint64_t>(capacity_));
       capacity_ = (empty_index_ / 2 < capacity_) ? empty_index_ : capacity_ * 2;
       tree_.resize(capacity_);
+      DRO_FLAT_PROBE(resize_return, static_cast<std::uint64_t>(capacity_));
     }
   }
 };
@@ -1262,7 +4180,8 @@ private:
 }// namespace details
 
 // Documentation:
-// FlatMap<Key, Value, MaxSize, Compare, Allocator>
+// FlatMap<Key, Value, MaxSize, Compare, Allocator, Lookup, Balance, Erase,
+//         Merkle, Storage, TopCache, Stats, Savepoint>
 // Key: Must be copyable or moveable type
 // Value: Must be copyable or moveable type
 // MaxSize: Integral type used for tree size optimizations.
@@ -1270,17 +4189,66 @@ private:
 //          specify and the node will use the new type and save space
 // Compare: Function used to compare keys, default std::less
 // Allocator: Allocator passed to the vector, takes a dro::details::Node
+// Lookup: Point lookup policy, default dro::NoLookupIndex.
+//         dro::HashLookupIndex<Hash> keeps a hash table from key to node
+//         index next to the tree, find, at and contains skip the binary search
+// Balance: Balancing policy, default dro::RedBlackBalance.
+//          dro::TopDownRedBlackBalance inserts and erases in a single pass
+//          down the tree and drops the parent index from every node,
+//          iterators keep the path from the root instead of the parents.
+//          dro::AVLBalance and dro::WAVLBalance keep shallower trees for
+//          lookup heavy maps, the allocator takes a dro::details::RankNode
+// Erase: Erase policy, default dro::EagerErase.
+//        dro::LazyErase<Percent> marks a tombstone that lookups and
+//        iterators skip and a re-insert of the key reuses, the nodes are
+//        removed in one batch once tombstones exceed Percent of the nodes
+// Merkle: Digest policy, default dro::NoMerkleHash.
+//         dro::MerkleHash<Hash> keeps the hash sum of every subtree for
+//         dro::equal and dro::diff, needs dro::RedBlackBalance. Hash is
+//         called on keys and values, default std::hash. Values handed out
+//         by at, operator[] or a non-const iterator are summed again on the
+//         next digest query
+// Storage: Node storage policy, default dro::VectorStorage.
+//          dro::CheckpointStorage<ChunkNodes> marks the chunks of nodes
+//          written since the last checkpoint, checkpoint appends only those
+//          to a file and recover reads them back. Key and Value must be
+//          trivially copyable
+// TopCache: Search cache policy, default dro::NoTopCache.
+//           dro::TopKeyCache<Levels> copies the keys of the top Levels
+//           levels into a breadth first array that searches read before the
+//           nodes, kept up to date from 16 << Levels nodes on
+// Stats: Counter policy, default dro::NoStats.
+//        dro::OperationStats counts comparisons, search depth, rotations,
+//        relocations, rebalancing steps, extrema cache hits and resizes for
+//        stats and reset_stats. Lookups count too, so concurrent readers
+//        race on the counters
+//        dro::PhaseStats also times the phases of the bottom up insert and
+//        erase into histograms for phase_times, two clock reads a phase.
+//        Needs dro::RedBlackBalance
+// Savepoint: Undo policy, default dro::NoSavepoints.
+//            dro::UndoSavepoints logs the old pair of every insert, erase
+//            and assignment while a savepoint is open for savepoint,
+//            rollback and release. Key and Value must be copyable
 
 template <details::FlatTree_Type Key, details::FlatTree_Type Value,
           details::Integral MaxSize = std::size_t,
           typename Compare          = std::less<Key>,
           typename Allocator =
-              std::allocator<details::Node<std::pair<Key, Value>, MaxSize>>>
-class FlatMap : public details::FlatRBTree<Key, Value, std::pair<Key, Value>,
-                                           MaxSize, Compare, Allocator> {
+              std::allocator<details::Node<std::pair<Key, Value>, MaxSize>>,
+          typename Lookup  = NoLookupIndex,
+          typename Balance = RedBlackBalance, typename Erase = EagerErase,
+          typename Merkle = NoMerkleHash, typename Storage = VectorStorage,
+          typename TopCache = NoTopCache, typename Stats = NoStats,
+          typename Savepoint = NoSavepoints>
+class FlatMap
+    : public details::FlatRBTree<Key, Value, std::pair<Key, Value>, MaxSize,
+                                 Compare, Allocator, Lookup, Balance, Erase,
+                                 Merkle, Storage, TopCache, Stats, Savepoint> {
   using size_type = MaxSize;
-  using tree_type = details::FlatRBTree<Key, Value, std::pair<Key, Value>,
-                                        MaxSize, Compare, Allocator>;
+  using tree_type =
+      details::FlatRBTree<Key, Value, std::pair<Key, Value>, MaxSize, Compare,
+                          Allocator, Lookup, Balance, Erase, Merkle, Storage,
+                          TopCache, Stats, Savepoint>;
 
 public:
   explicit FlatMap(size_type capacity = 1, Allocator allocator = Allocator())
@@ -1288,30 +4256,63 @@ public:
 };
 
 // Documentation:
-// FlatSet<Key, MaxSize, Compare, Allocator>
+// FlatSet<Key, MaxSize, Compare, Allocator, Lookup, Balance, Erase, Merkle,
+//         Storage, TopCache, Stats, Savepoint>
 // Key: Must be copyable or moveable type
 // MaxSize: Integral type used for tree size optimizations.
 //          If you know the max size is less than default std::size_t, then
 //          specify and the node will use the new type and save space
 // Compare: Function used to compare keys, default std::less
 // Allocator: Allocator passed to the vector, takes a dro::details::Node
+// Lookup: Point lookup policy, default dro::NoLookupIndex
+// Balance: Balancing policy, default dro::RedBlackBalance
+// Erase: Erase policy, default dro::EagerErase
+// Merkle: Digest policy, default dro::NoMerkleHash
+// Storage: Node storage policy, default dro::VectorStorage
+// TopCache: Search cache policy, default dro::NoTopCache
+// Stats: Counter policy, default dro::NoStats
+// Savepoint: Undo policy, default dro::NoSavepoints
 
 template <details::FlatTree_Type Key, details::Integral MaxSize = std::size_t,
           typename Compare = std::less<Key>,
           typename Allocator =
-              std::allocator<details::Node<details::FlatSetPair<Key>, MaxSize>>>
-class FlatSet : public details::FlatRBTree<Key, details::FlatSetEmptyType,
-                                           details::FlatSetPair<Key>, MaxSize,
-                                           Compare, Allocator> {
+              std::allocator<details::Node<details::FlatSetPair<Key>, MaxSize>>,
+          typename Lookup  = NoLookupIndex,
+          typename Balance = RedBlackBalance, typename Erase = EagerErase,
+          typename Merkle = NoMerkleHash, typename Storage = VectorStorage,
+          typename TopCache = NoTopCache, typename Stats = NoStats,
+          typename Savepoint = NoSavepoints>
+class FlatSet
+    : public details::FlatRBTree<Key, details::FlatSetEmptyType,
+                                 details::FlatSetPair<Key>, MaxSize, Compare,
+                                 Allocator, Lookup, Balance, Erase, Merkle,
+                                 Storage, TopCache, Stats, Savepoint> {
   using size_type = MaxSize;
-  using tree_type = details::FlatRBTree<Key, details::FlatSetEmptyType,
-                                        details::FlatSetPair<Key>, MaxSize,
-                                        Compare, Allocator>;
+  using tree_type =
+      details::FlatRBTree<Key, details::FlatSetEmptyType,
+                          details::FlatSetPair<Key>, MaxSize, Compare,
+                          Allocator, Lookup, Balance, Erase, Merkle, Storage,
+                          TopCache, Stats, Savepoint>;
 
 public:
   explicit FlatSet(size_type capacity = 1, Allocator allocator = Allocator())
       : tree_type(capacity, allocator) {}
 };
 
+// Same elements, compares the root digests of two dro::MerkleHash trees.
+// Equal digests of different elements need a 64 bit hash collision.
+template <typename... Params>
+[[nodiscard]] bool equal(const details::FlatRBTree<Params...>& lhs,
+                         const details::FlatRBTree<Params...>& rhs) {
+  return lhs.size() == rhs.size() && lhs.digest() == rhs.digest();
+}
+
+// Sorted keys that differ between two dro::MerkleHash trees
+template <typename... Params>
+[[nodiscard]] auto diff(const details::FlatRBTree<Params...>& lhs,
+                        const details::FlatRBTree<Params...>& rhs) {
+  return lhs.diff(rhs);
+}
+
 }// namespace dro
 #endif
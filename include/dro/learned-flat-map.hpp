@@ -0,0 +1,253 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#ifndef DRO_LEARNED_FLAT_MAP
+#define DRO_LEARNED_FLAT_MAP
+
+#include <algorithm>  // for sort, is_sorted, lower_bound, upper_bound
+#include <concepts>   // for integral
+#include <cstddef>    // for size_t
+#include <limits>     // for numeric_limits
+#include <stdexcept>  // for out_of_range
+#include <type_traits>// for make_unsigned
+#include <utility>    // for pair
+#include <vector>     // for vector
+
+namespace dro {
+namespace details {
+
+// One linear piece of the model: position = intercept_ + slope_ * (key - key_)
+template <std::integral Key> struct LearnedSegment {
+  Key key_ {};
+  double slope_ {};
+  std::size_t intercept_ {};
+
+  [[nodiscard]] std::size_t predict(Key key, std::size_t last) const {
+    double position = static_cast<double>(intercept_) +
+                      slope_ * _distance(key_, key);
+    if (position <= 0.0) {
+      return 0;
+    }
+    auto index = static_cast<std::size_t>(position);
+    return (index > last) ? last : index;
+  }
+
+  // Unsigned distance avoids overflow for keys at the limits of the type
+  static double _distance(Key from, Key to) {
+    using unsigned_type = std::make_unsigned_t<Key>;
+    if (to < from) {
+      return -static_cast<double>(static_cast<unsigned_type>(
+          static_cast<unsigned_type>(from) - static_cast<unsigned_type>(to)));
+    }
+    return static_cast<double>(static_cast<unsigned_type>(
+        static_cast<unsigned_type>(to) - static_cast<unsigned_type>(from)));
+  }
+};
+
+// Greedy shrinking cone: extends a segment while one slope keeps every
+// point within Epsilon positions of its prediction. Keys are strictly
+// increasing, a repeated key would divide by a zero distance.
+template <std::integral Key, std::size_t Epsilon>
+std::vector<LearnedSegment<Key>> buildLearnedSegments(const auto& keys) {
+  using segment_type = LearnedSegment<Key>;
+  std::vector<segment_type> segments;
+  const std::size_t size = keys.size();
+  std::size_t first {};
+  while (first < size) {
+    double slopeLow  = 0.0;
+    double slopeHigh = std::numeric_limits<double>::max();
+    std::size_t last = first + 1;
+    for (; last < size; ++last) {
+      double dx = segment_type::_distance(keys[first], keys[last]);
+      double dy = static_cast<double>(last - first);
+      double low  = (dy - static_cast<double>(Epsilon)) / dx;
+      double high = (dy + static_cast<double>(Epsilon)) / dx;
+      if (low > slopeHigh || high < slopeLow) {
+        break;
+      }
+      slopeLow  = std::max(slopeLow, low);
+      slopeHigh = std::min(slopeHigh, high);
+    }
+    double slope = (last == first + 1) ? 0.0 : (slopeLow + slopeHigh) / 2;
+    segments.push_back({keys[first], slope, first});
+    first = last;
+  }
+  return segments;
+}
+
+}// namespace details
+
+// Documentation:
+// LearnedFlatMap<Key, Value, Epsilon>
+// Read only map for integral keys. The sorted keys are indexed by a
+// recursive piecewise linear model of their distribution, a lookup predicts
+// a position at each level and finishes with a search of 2 * Epsilon + 3
+// elements, one extra on each side for the rounding of the prediction.
+// Key: Integral type
+// Value: Must be copyable or moveable type
+// Epsilon: Maximum prediction error of the model, in elements
+
+template <std::integral Key, typename Value, std::size_t Epsilon = 32>
+class LearnedFlatMap {
+public:
+  using key_type       = Key;
+  using mapped_type    = Value;
+  using value_type     = std::pair<Key, Value>;
+  using size_type      = std::size_t;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+private:
+  using segment_type = details::LearnedSegment<Key>;
+
+  std::vector<value_type> pairs_;
+  // levels_[0] models the keys, each level above models the one below it
+  std::vector<std::vector<segment_type>> levels_;
+
+public:
+  LearnedFlatMap() = default;
+
+  // Builds from any container of key value pairs, e.g. dro::FlatMap. Of
+  // duplicate keys the first pair is kept.
+  template <typename Container>
+  explicit LearnedFlatMap(const Container& container) {
+    for (const auto& pair : container) {
+      pairs_.emplace_back(pair.first, pair.second);
+    }
+    if (! std::is_sorted(pairs_.begin(), pairs_.end(), _compare)) {
+      std::stable_sort(pairs_.begin(), pairs_.end(), _compare);
+    }
+    pairs_.erase(std::unique(pairs_.begin(), pairs_.end(),
+                             [](const value_type& lhs, const value_type& rhs) {
+                               return lhs.first == rhs.first;
+                             }),
+                 pairs_.end());
+    _buildModel();
+  }
+
+  // Iterators
+  [[nodiscard]] const_iterator begin() const noexcept { return pairs_.begin(); }
+
+  [[nodiscard]] const_iterator end() const noexcept { return pairs_.end(); }
+
+  // Capacity
+  [[nodiscard]] size_type size() const noexcept { return pairs_.size(); }
+
+  [[nodiscard]] bool empty() const noexcept { return pairs_.empty(); }
+
+  [[nodiscard]] size_type segments() const noexcept {
+    size_type count {};
+    for (const auto& level : levels_) { count += level.size(); }
+    return count;
+  }
+
+  // Lookup
+  [[nodiscard]] const mapped_type& at(const key_type& key) const {
+    auto iter = find(key);
+    if (iter == end()) {
+      throw std::out_of_range("dro::LearnedFlatMap::at");
+    }
+    return iter->second;
+  }
+
+  [[nodiscard]] const_iterator find(const key_type& key) const {
+    auto iter = lower_bound(key);
+    return (iter != end() && iter->first == key) ? iter : end();
+  }
+
+  [[nodiscard]] bool contains(const key_type& key) const {
+    return find(key) != end();
+  }
+
+  [[nodiscard]] size_type count(const key_type& key) const {
+    return contains(key);
+  }
+
+  [[nodiscard]] const_iterator lower_bound(const key_type& key) const {
+    if (pairs_.empty()) {
+      return end();
+    }
+    return pairs_.begin() +
+           static_cast<std::ptrdiff_t>(_lowerBoundIndex(key));
+  }
+
+  [[nodiscard]] const_iterator upper_bound(const key_type& key) const {
+    auto iter = lower_bound(key);
+    return (iter != end() && iter->first == key) ? iter + 1 : iter;
+  }
+
+private:
+  static bool _compare(const value_type& lhs, const value_type& rhs) {
+    return lhs.first < rhs.first;
+  }
+
+  void _buildModel() {
+    if (pairs_.empty()) {
+      return;
+    }
+    std::vector<Key> keys(pairs_.size());
+    for (std::size_t i {}; i < pairs_.size(); ++i) {
+      keys[i] = pairs_[i].first;
+    }
+    levels_.push_back(details::buildLearnedSegments<Key, Epsilon>(keys));
+    while (levels_.back().size() > 1) {
+      const auto& lower = levels_.back();
+      keys.resize(lower.size());
+      for (std::size_t i {}; i < lower.size(); ++i) { keys[i] = lower[i].key_; }
+      levels_.push_back(details::buildLearnedSegments<Key, Epsilon>(keys));
+    }
+  }
+
+  // Index of the last segment in level whose key is not greater than key
+  std::size_t _segmentIndex(const std::vector<segment_type>& level,
+                            std::size_t guess, const key_type& key) const {
+    auto compare = [](const segment_type& segment, const key_type& value) {
+      return segment.key_ <= value;
+    };
+    std::size_t low  = (guess > Epsilon + 1) ? guess - Epsilon - 1 : 0;
+    std::size_t high = std::min(guess + Epsilon + 2, level.size());
+    // Widen to the full level if the model missed, from rounding or from a
+    // key past the last one of its segment
+    if ((low > 0 && key < level[low].key_) ||
+        (high < level.size() && level[high].key_ <= key)) {
+      low  = 0;
+      high = level.size();
+    }
+    auto first = level.begin() + static_cast<std::ptrdiff_t>(low);
+    auto last  = level.begin() + static_cast<std::ptrdiff_t>(high);
+    auto iter  = std::lower_bound(first, last, key, compare);
+    auto index = static_cast<std::size_t>(iter - level.begin());
+    return index ? index - 1 : 0;
+  }
+
+  std::size_t _lowerBoundIndex(const key_type& key) const {
+    std::size_t segment {};
+    for (std::size_t level = levels_.size() - 1; level > 0; --level) {
+      std::size_t guess = levels_[level][segment].predict(
+          key, levels_[level - 1].size() - 1);
+      segment = _segmentIndex(levels_[level - 1], guess, key);
+    }
+    std::size_t guess =
+        levels_[0][segment].predict(key, pairs_.size() - 1);
+    auto compare = [](const value_type& pair, const key_type& value) {
+      return pair.first < value;
+    };
+    std::size_t low  = (guess > Epsilon + 1) ? guess - Epsilon - 1 : 0;
+    std::size_t high = std::min(guess + Epsilon + 2, pairs_.size());
+    if ((low > 0 && ! (pairs_[low - 1].first < key)) ||
+        (high < pairs_.size() && pairs_[high - 1].first < key)) {
+      low  = 0;
+      high = pairs_.size();
+    }
+    auto first = pairs_.begin() + static_cast<std::ptrdiff_t>(low);
+    auto last  = pairs_.begin() + static_cast<std::ptrdiff_t>(high);
+    auto iter  = std::lower_bound(first, last, key, compare);
+    return static_cast<std::size_t>(iter - pairs_.begin());
+  }
+};
+
+}// namespace dro
+#endif
@@ -0,0 +1,78 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/elias-fano-set.hpp"
+#include "dro/flat-rb-tree.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+void runEliasFanoSetTests() {
+
+  {
+    dro::FlatSet<uint32_t, uint32_t> flatsetA;
+    dro::FlatSet<uint32_t, uint32_t> flatsetB;
+    for (int i {}; i < 20'000; ++i) {
+      flatsetA.insert(static_cast<uint32_t>(rand() % 100'000));
+      flatsetB.insert(static_cast<uint32_t>(rand() % 100'000));
+    }
+    std::vector<uint32_t> keysA(flatsetA.begin(), flatsetA.end());
+    std::vector<uint32_t> keysB(flatsetB.begin(), flatsetB.end());
+    dro::EliasFanoSet<uint32_t> setA(flatsetA);
+    dro::EliasFanoSet<uint32_t> setB(flatsetB);
+    assert(setA.size() == keysA.size());
+    assert(setA.bytes() < keysA.size() * sizeof(uint32_t));
+    assert(std::equal(setA.begin(), setA.end(), keysA.begin(), keysA.end()));
+    for (std::size_t i {}; i < keysA.size(); i += 7) {
+      assert(setA.at(i) == keysA[i]);
+    }
+    for (uint32_t key {}; key < 100'010; ++key) {
+      auto expected = std::lower_bound(keysA.begin(), keysA.end(), key);
+      auto result   = setA.lower_bound(key);
+      if (expected == keysA.end()) {
+        assert(result == setA.end());
+      } else {
+        assert(*result == *expected);
+      }
+      assert(setA.contains(key) == flatsetA.contains(key));
+    }
+    std::vector<uint32_t> expected;
+    std::set_intersection(keysA.begin(), keysA.end(), keysB.begin(),
+                          keysB.end(), std::back_inserter(expected));
+    assert(setA.intersection(setB) == expected);
+    assert(setB.intersection(setA) == expected);
+  }
+
+  // Sparse keys spanning the full range of the type
+  {
+    std::vector<uint64_t> keys = {0, 1, 2, 1'000, 1ULL << 40, (1ULL << 40) + 1,
+                                  std::numeric_limits<uint64_t>::max()};
+    dro::EliasFanoSet<uint64_t> set(keys);
+    assert(std::equal(set.begin(), set.end(), keys.begin(), keys.end()));
+    assert(*set.lower_bound(3) == 1'000);
+    assert(*set.upper_bound(1ULL << 40) == (1ULL << 40) + 1);
+    assert(set.contains(std::numeric_limits<uint64_t>::max()));
+    assert(! set.contains(std::numeric_limits<uint64_t>::max() - 1));
+  }
+
+  {
+    dro::EliasFanoSet<uint64_t> set;
+    assert(set.empty());
+    assert(set.begin() == set.end());
+    assert(set.lower_bound(5) == set.end());
+    std::vector<uint64_t> single = {42};
+    dro::EliasFanoSet<uint64_t> one(single);
+    assert(*one.lower_bound(0) == 42);
+    assert(one.lower_bound(43) == one.end());
+    assert(one.intersection(set).empty());
+  }
+}
@@ -0,0 +1,272 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+
+template <typename Key, typename Value, typename Balance>
+using BalancedFlatMap = dro::FlatMap<
+    Key, Value, uint32_t, std::less<Key>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<Key, Value>, uint32_t>>,
+    dro::NoLookupIndex, Balance>;
+
+template <typename Key, typename Value>
+using TopDownFlatMap =
+    BalancedFlatMap<Key, Value, dro::TopDownRedBlackBalance>;
+
+// Returns the black height of the subtree, checks the key order, the red
+// rule and that every node lives in [0, size)
+template <typename Tree, typename Index>
+int validateRedBlackNode(const Tree& tree, Index node, std::size_t& count) {
+  if (node == tree.empty_index_) {
+    return 1;
+  }
+  assert(node < tree.size());
+  ++count;
+  const auto& nodeRef = tree.tree_[node];
+  for (auto child : {nodeRef.left_, nodeRef.right_}) {
+    if (child != tree.empty_index_) {
+      // Red node with a red child
+      assert(nodeRef.color_ || tree.tree_[child].color_);
+    }
+  }
+  if (nodeRef.left_ != tree.empty_index_) {
+    assert(tree.key_comp()(tree.tree_[nodeRef.left_].pair_.first,
+                           nodeRef.pair_.first));
+  }
+  if (nodeRef.right_ != tree.empty_index_) {
+    assert(tree.key_comp()(nodeRef.pair_.first,
+                           tree.tree_[nodeRef.right_].pair_.first));
+  }
+  int left  = validateRedBlackNode(tree, nodeRef.left_, count);
+  int right = validateRedBlackNode(tree, nodeRef.right_, count);
+  assert(left == right);
+  return left + static_cast<int>(nodeRef.color_);
+}
+
+// Returns the rank of the subtree, checks the key order and the rank rule
+template <bool Weak, typename Tree, typename Index>
+int validateRankNode(const Tree& tree, Index node, std::size_t& count) {
+  if (node == tree.empty_index_) {
+    return -1;
+  }
+  assert(node < tree.size());
+  ++count;
+  const auto& nodeRef = tree.tree_[node];
+  if (nodeRef.left_ != tree.empty_index_) {
+    assert(tree.key_comp()(tree.tree_[nodeRef.left_].pair_.first,
+                           nodeRef.pair_.first));
+  }
+  if (nodeRef.right_ != tree.empty_index_) {
+    assert(tree.key_comp()(nodeRef.pair_.first,
+                           tree.tree_[nodeRef.right_].pair_.first));
+  }
+  int left  = validateRankNode<Weak>(tree, nodeRef.left_, count);
+  int right = validateRankNode<Weak>(tree, nodeRef.right_, count);
+  int rank  = nodeRef.rank_;
+  if constexpr (Weak) {
+    // Rank differences of one or two, leaves have rank zero
+    assert(rank - left >= 1 && rank - left <= 2);
+    assert(rank - right >= 1 && rank - right <= 2);
+    assert(left != -1 || right != -1 || rank == 0);
+  } else {
+    // Rank is the height, children differ by at most one
+    assert(rank == 1 + std::max(left, right));
+    assert(left - right <= 1 && right - left <= 1);
+  }
+  return rank;
+}
+
+// Node count and cached extrema, shared by every balance policy
+template <typename Tree>
+void validateShape(const Tree& tree, std::size_t count) {
+  assert(count == tree.size() + tree.tombstones_.count());
+  // Cached extrema are the leftmost and rightmost nodes
+  auto first = tree.root_;
+  auto last  = tree.root_;
+  while (first != tree.empty_index_ &&
+         tree.tree_[first].left_ != tree.empty_index_) {
+    first = tree.tree_[first].left_;
+  }
+  while (last != tree.empty_index_ &&
+         tree.tree_[last].right_ != tree.empty_index_) {
+    last = tree.tree_[last].right_;
+  }
+  assert(tree.firstIndexCache_ == first && tree.lastIndexCache_ == last);
+}
+
+template <typename Tree> void validateRedBlack(const Tree& tree) {
+  std::size_t count {};
+  if (tree.root_ != tree.empty_index_) {
+    assert(tree.tree_[tree.root_].color_);
+  }
+  validateRedBlackNode(tree, tree.root_, count);
+  validateShape(tree, count);
+}
+
+template <bool Weak, typename Tree> void validateRank(const Tree& tree) {
+  std::size_t count {};
+  validateRankNode<Weak>(tree, tree.root_, count);
+  validateShape(tree, count);
+}
+
+template <typename Balance, typename Tree>
+void validateBalance(const Tree& tree) {
+  if constexpr (std::is_same_v<Balance, dro::AVLBalance>) {
+    validateRank<false>(tree);
+  } else if constexpr (std::is_same_v<Balance, dro::WAVLBalance>) {
+    validateRank<true>(tree);
+  } else {
+    validateRedBlack(tree);
+  }
+}
+
+template <typename Balance> void runBalanceRandomTest(int range, int iters) {
+  BalancedFlatMap<int, int, Balance> flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rd % 3) {
+      auto result = flatmap.emplace(rd, i);
+      assert(result.second == stlmap.emplace(rd, i).second);
+      assert(result.first->first == rd);
+    } else if (rd % 2) {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    } else {
+      flatmap.erase_and_discard(flatmap.find(rd));
+      stlmap.erase(rd);
+    }
+    if (i % 97 == 0) {
+      validateBalance<Balance>(flatmap);
+    }
+  }
+  validateBalance<Balance>(flatmap);
+  assert(flatmap.size() == stlmap.size());
+  // Forward and reverse iteration
+  auto stlIt = stlmap.begin();
+  for (const auto& elem : flatmap) {
+    assert(elem.first == stlIt->first && elem.second == stlIt->second);
+    ++stlIt;
+  }
+  auto stlRevIt = stlmap.rbegin();
+  for (auto it = flatmap.rbegin(); it != flatmap.rend(); ++it) {
+    assert(it->first == stlRevIt->first);
+    ++stlRevIt;
+  }
+  for (int i {}; i < range; i += 7) {
+    auto flatIt = flatmap.lower_bound(i);
+    auto stlLb  = stlmap.lower_bound(i);
+    assert((flatIt == flatmap.end()) == (stlLb == stlmap.end()));
+    if (stlLb != stlmap.end()) {
+      assert(flatIt->first == stlLb->first);
+    }
+  }
+  // Erase by iterator returns the successor
+  while (! flatmap.empty()) {
+    auto stlNext = stlmap.erase(stlmap.begin());
+    auto next    = flatmap.erase(flatmap.begin());
+    assert((next == flatmap.end()) == (stlNext == stlmap.end()));
+    if (stlNext != stlmap.end()) {
+      assert(next->first == stlNext->first);
+    }
+    validateBalance<Balance>(flatmap);
+  }
+}
+
+// Sorted and reverse sorted insertion, erase from the middle
+template <typename Balance> void runBalanceSortedTest() {
+  BalancedFlatMap<int, std::string, Balance> flatmap;
+  for (int i {}; i < 1'000; ++i) { flatmap[i] = std::to_string(i); }
+  for (int i = 2'000; i > 1'000; --i) { flatmap[i] = std::to_string(i); }
+  validateBalance<Balance>(flatmap);
+  for (int i = 500; i < 1'500; ++i) {
+    assert(flatmap.erase(i) == (i != 1'000));
+  }
+  validateBalance<Balance>(flatmap);
+  assert(flatmap.size() == 1'001);
+  assert(flatmap.at(499) == "499" && flatmap.at(1'500) == "1500");
+  assert(! flatmap.contains(1'000));
+}
+
+// Lookup policies keep working without parent links
+template <typename Balance> void runBalanceLookupTest() {
+  dro::FlatMap<int, int, uint32_t, std::less<int>,
+               std::allocator<dro::details::Node<std::pair<int, int>,
+                                                 uint32_t>>,
+               dro::HashLookupIndex<>, Balance>
+      flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < 20'000; ++i) {
+    int rd = rand() % 4'000;
+    if (rd % 3) {
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    } else {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    }
+  }
+  for (int i {}; i < 4'000; ++i) {
+    assert(flatmap.contains(i) == stlmap.contains(i));
+  }
+}
+
+void runBalanceTests() {
+
+  // Bottom up red black tree, erase by key skips the successor walk
+  runBalanceRandomTest<dro::RedBlackBalance>(64, 2'000);
+  runBalanceRandomTest<dro::RedBlackBalance>(5'000, 20'000);
+
+  // Top down red black tree without parent links
+  static_assert(sizeof(TopDownFlatMap<int, int>::node_type) <
+                sizeof(dro::FlatMap<int, int, uint32_t>::node_type));
+  runBalanceRandomTest<dro::TopDownRedBlackBalance>(64, 2'000);
+  runBalanceRandomTest<dro::TopDownRedBlackBalance>(5'000, 20'000);
+  runBalanceSortedTest<dro::TopDownRedBlackBalance>();
+
+  // Rank balanced trees
+  runBalanceRandomTest<dro::AVLBalance>(64, 2'000);
+  runBalanceRandomTest<dro::AVLBalance>(5'000, 20'000);
+  runBalanceRandomTest<dro::WAVLBalance>(64, 2'000);
+  runBalanceRandomTest<dro::WAVLBalance>(5'000, 20'000);
+  runBalanceSortedTest<dro::AVLBalance>();
+  runBalanceSortedTest<dro::WAVLBalance>();
+
+  // Set with a reversed comparator
+  {
+    dro::FlatSet<int, uint16_t, std::greater<int>,
+                 std::allocator<dro::details::Node<
+                     dro::details::FlatSetPair<int>, uint16_t, false>>,
+                 dro::NoLookupIndex, dro::TopDownRedBlackBalance>
+        flatset;
+    std::set<int, std::greater<int>> stlset;
+    for (int i {}; i < 10'000; ++i) {
+      int rd = rand() % 2'000;
+      if (rd % 2) {
+        assert(flatset.insert(rd).second == stlset.insert(rd).second);
+      } else {
+        assert(flatset.erase(rd) == stlset.erase(rd));
+      }
+    }
+    auto stlIt = stlset.begin();
+    for (int key : flatset) { assert(key == *stlIt++); }
+  }
+
+  runBalanceLookupTest<dro::TopDownRedBlackBalance>();
+  runBalanceLookupTest<dro::WAVLBalance>();
+}
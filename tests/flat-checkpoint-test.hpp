@@ -0,0 +1,206 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template <typename Lookup, typename Erase, typename MaxSize = uint32_t,
+          std::size_t ChunkNodes = 64>
+using CheckpointFlatMap = dro::FlatMap<
+    int, int, MaxSize, std::less<int>,
+    std::allocator<dro::details::Node<std::pair<int, int>, MaxSize>>, Lookup,
+    dro::RedBlackBalance, Erase, dro::NoMerkleHash,
+    dro::CheckpointStorage<ChunkNodes>>;
+
+// Same slots, links and colors as the checkpointed tree
+template <typename Tree> void checkRecovered(const Tree& lhs, const Tree& rhs) {
+  assert(lhs.size() == rhs.size() && lhs.root_ == rhs.root_);
+  assert(lhs.firstIndexCache_ == rhs.firstIndexCache_);
+  assert(lhs.lastIndexCache_ == rhs.lastIndexCache_);
+  for (std::size_t index {}; index < lhs.size(); ++index) {
+    const auto& left  = lhs.tree_[index];
+    const auto& right = rhs.tree_[index];
+    assert(left.pair_ == right.pair_ && left.parent_ == right.parent_);
+    assert(left.left_ == right.left_ && left.right_ == right.right_);
+    assert(left.color_ == right.color_);
+  }
+}
+
+std::size_t checkpointFileSize(int fd) {
+  struct stat status {};
+  fstat(fd, &status);
+  return static_cast<std::size_t>(status.st_size);
+}
+
+template <typename Lookup, typename Erase, typename MaxSize = uint32_t>
+void runCheckpointRandomTest() {
+  std::FILE* file = std::tmpfile();
+  int fd          = fileno(file);
+  CheckpointFlatMap<Lookup, Erase, MaxSize> flatmap;
+  std::map<int, int> stlmap;
+  for (int round {}; round < 40; ++round) {
+    for (int i {}; i < 200; ++i) {
+      int rd = rand() % 2'000;
+      if (rd % 3) {
+        flatmap[rd] = i;
+        stlmap[rd]  = i;
+      } else {
+        assert(flatmap.erase(rd) == stlmap.erase(rd));
+      }
+    }
+    if (round % 2) {
+      flatmap.checkpoint(fd);
+    } else {
+      flatmap.checkpoint_async(fd).get();
+    }
+    CheckpointFlatMap<Lookup, Erase, MaxSize> recovered;
+    recovered.recover(fd);
+    checkRecovered(flatmap, recovered);
+    for (const auto& [key, value] : stlmap) {
+      assert(recovered.at(key) == value);
+    }
+    assert(! recovered.contains(-1));
+  }
+  std::fclose(file);
+}
+
+void runCheckpointTests() {
+
+  runCheckpointRandomTest<dro::NoLookupIndex, dro::EagerErase>();
+  runCheckpointRandomTest<dro::HashLookupIndex<>, dro::LazyErase<>>();
+  runCheckpointRandomTest<dro::NoLookupIndex, dro::EagerErase, std::size_t>();
+
+  // Default size_t MaxSize, lookups and inserts of present keys leave the
+  // chunks clean
+  {
+    std::FILE* file = std::tmpfile();
+    int fd          = fileno(file);
+    CheckpointFlatMap<dro::NoLookupIndex, dro::EagerErase, std::size_t, 4'096>
+        flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[i] = i; }
+    for (int i {}; i < 1'000; i += 7) { flatmap.erase(i); }
+    flatmap.checkpoint(fd);
+    std::size_t fullBytes = checkpointFileSize(fd);
+    for (int i {}; i < 1'000; ++i) {
+      assert(flatmap.contains(i) == static_cast<bool>(i % 7));
+      if (i % 7) {
+        assert(! flatmap.insert({i, -1}).second);
+      }
+    }
+    flatmap.checkpoint(fd);
+    assert((checkpointFileSize(fd) - fullBytes) * 50 < fullBytes);
+    decltype(flatmap) recovered;
+    recovered.recover(fd);
+    checkRecovered(flatmap, recovered);
+    std::fclose(file);
+  }
+
+  // Incremental checkpoints write the changed chunks only
+  {
+    std::FILE* file = std::tmpfile();
+    int fd          = fileno(file);
+    CheckpointFlatMap<dro::NoLookupIndex, dro::EagerErase> flatmap;
+    for (int i {}; i < 10'000; ++i) { flatmap[i] = i; }
+    flatmap.checkpoint(fd);
+    std::size_t fullBytes = checkpointFileSize(fd);
+    flatmap.at(5'000) = -1;
+    flatmap.checkpoint(fd);
+    std::size_t deltaBytes = checkpointFileSize(fd) - fullBytes;
+    assert(deltaBytes * 50 < fullBytes);
+    // The tree changes while the async checkpoint writes its copy
+    auto future = flatmap.checkpoint_async(fd);
+    flatmap[20'000] = 1;
+    future.get();
+    decltype(flatmap) recovered;
+    recovered.recover(fd);
+    assert(recovered.size() == 10'000 && recovered.at(5'000) == -1);
+    assert(! recovered.contains(20'000));
+
+    // A torn write after the last manifest is ignored
+    flatmap.checkpoint(fd);
+    std::size_t committed = checkpointFileSize(fd);
+    flatmap.erase(0);
+    flatmap.checkpoint(fd);
+    assert(ftruncate(fd, static_cast<off_t>(checkpointFileSize(fd) - 8)) == 0);
+    recovered.recover(fd);
+    assert(recovered.size() == 10'001 && recovered.contains(0));
+    assert(ftruncate(fd, static_cast<off_t>(committed)) == 0);
+    recovered.recover(fd);
+    checkRecovered(recovered, recovered);
+    assert(recovered.at(20'000) == 1);
+    std::fclose(file);
+  }
+
+  // Recover cuts a torn tail off, later checkpoints follow the manifest
+  {
+    std::FILE* file = std::tmpfile();
+    int fd          = fileno(file);
+    CheckpointFlatMap<dro::NoLookupIndex, dro::EagerErase> flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[i] = i; }
+    flatmap.checkpoint(fd, true);
+    std::size_t committed = checkpointFileSize(fd);
+    std::array<char, 40> junk {};
+    junk.fill('x');
+    assert(write(fd, junk.data(), junk.size()) == 40);
+    decltype(flatmap) recovered;
+    recovered.recover(fd);
+    assert(checkpointFileSize(fd) == committed && recovered.size() == 1'000);
+    for (int i = 1'000; i < 2'000; ++i) { recovered[i] = i; }
+    recovered.checkpoint(fd);
+    decltype(flatmap) again;
+    again.recover(fd);
+    assert(again.size() == 2'000);
+    checkRecovered(recovered, again);
+    std::fclose(file);
+  }
+
+  // A manifest with a root past its size throws
+  {
+    std::FILE* file = std::tmpfile();
+    int fd          = fileno(file);
+    using Tree      = CheckpointFlatMap<dro::NoLookupIndex, dro::EagerErase>;
+    dro::details::FlatTreeCheckpointRecord manifest;
+    manifest.kind_       = manifest.manifest_;
+    manifest.nodeBytes_  = sizeof(Tree::node_type);
+    manifest.chunkNodes_ = 64;
+    manifest.count_      = 5;
+    assert(write(fd, &manifest, sizeof(manifest)) ==
+           static_cast<ssize_t>(sizeof(manifest)));
+    Tree flatmap;
+    bool thrown {};
+    try {
+      flatmap.recover(fd);
+    } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+    std::fclose(file);
+  }
+
+  // Recovering an empty file throws
+  {
+    std::FILE* file = std::tmpfile();
+    CheckpointFlatMap<dro::NoLookupIndex, dro::EagerErase> flatmap;
+    bool thrown {};
+    try {
+      flatmap.recover(fileno(file));
+    } catch (const std::runtime_error&) { thrown = true; }
+    assert(thrown);
+    std::fclose(file);
+  }
+}
@@ -0,0 +1,109 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <span>
+#include <utility>
+#include <vector>
+
+template <typename Tree> void runExportRandomTest(int range, int iters) {
+  Tree flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rd % 3) {
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    } else {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    }
+  }
+  std::vector<std::pair<int, int>> expected(stlmap.begin(), stlmap.end());
+  assert(flatmap.to_sorted_vector() == expected);
+  for (std::size_t threads : {2, 3, 8, 64}) {
+    assert(flatmap.to_sorted_vector(threads) == expected);
+  }
+  std::vector<int> keys, values;
+  flatmap.copy_keys(std::back_inserter(keys));
+  flatmap.copy_values(std::back_inserter(values));
+  assert(keys.size() == expected.size() && values.size() == expected.size());
+  for (std::size_t i {}; i < expected.size(); ++i) {
+    assert(keys[i] == expected[i].first && values[i] == expected[i].second);
+  }
+  // Bounds inside, outside and between the keys, every chunk is full but
+  // the last one
+  for (int i {}; i < 50; ++i) {
+    int low                = rand() % (range + 20) - 10;
+    int high               = low + rand() % (range / 2 + 1);
+    std::size_t chunk_size = static_cast<std::size_t>(rand() % 40 + 1);
+    std::size_t lastSize   = chunk_size;
+    std::vector<std::pair<int, int>> exported;
+    auto callback = [&](std::span<const std::pair<int, int>> chunk) {
+      assert(lastSize == chunk_size);
+      assert(! chunk.empty() && chunk.size() <= chunk_size);
+      lastSize = chunk.size();
+      exported.insert(exported.end(), chunk.begin(), chunk.end());
+    };
+    flatmap.export_range(low, high, callback, chunk_size);
+    std::vector<std::pair<int, int>> inRange(stlmap.lower_bound(low),
+                                             stlmap.lower_bound(high));
+    assert(exported == inRange);
+  }
+}
+
+void runExportTests() {
+
+  runExportRandomTest<dro::FlatMap<int, int>>(64, 2'000);
+  runExportRandomTest<dro::FlatMap<int, int>>(5'000, 20'000);
+  runExportRandomTest<dro::FlatMap<
+      int, int, uint32_t, std::less<int>,
+      std::allocator<dro::details::Node<std::pair<int, int>, uint32_t>>,
+      dro::NoLookupIndex, dro::RedBlackBalance, dro::LazyErase<>>>(5'000,
+                                                                  20'000);
+  runExportRandomTest<dro::FlatMap<
+      int, int, uint32_t, std::less<int>,
+      std::allocator<dro::details::RankNode<std::pair<int, int>, uint32_t>>,
+      dro::NoLookupIndex, dro::AVLBalance>>(5'000, 20'000);
+
+  // Sets export keys, empty trees export nothing
+  {
+    dro::FlatSet<int, uint32_t, std::greater<int>> flatset;
+    assert(flatset.to_sorted_vector(4).empty());
+    flatset.export_range(10, 0, [](std::span<const int>) { assert(false); });
+    std::set<int, std::greater<int>> stlset;
+    for (int i {}; i < 1'000; ++i) {
+      int rd = rand() % 500;
+      flatset.insert(rd);
+      stlset.insert(rd);
+    }
+    std::vector<int> expected(stlset.begin(), stlset.end());
+    assert(flatset.to_sorted_vector() == expected);
+    assert(flatset.to_sorted_vector(4) == expected);
+    std::vector<int> keys(flatset.size());
+    assert(flatset.copy_keys(keys.begin()) == keys.end());
+    assert(keys == expected);
+    std::vector<int> exported;
+    flatset.export_range(300, 100, [&exported](std::span<const int> chunk) {
+      exported.insert(exported.end(), chunk.begin(), chunk.end());
+    });
+    assert(exported.size() == static_cast<std::size_t>(std::distance(
+                                  stlset.lower_bound(300),
+                                  stlset.lower_bound(100))));
+    assert(exported.front() <= 300 && exported.back() > 100);
+  }
+}
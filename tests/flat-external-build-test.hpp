@@ -0,0 +1,148 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-external-build.hpp"
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+template <typename Balance, typename MaxSize = uint32_t>
+using ExternalFlatMap = dro::FlatMap<
+    int, int, MaxSize, std::less<int>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<int, int>, MaxSize>>,
+    dro::NoLookupIndex, Balance, dro::EagerErase, dro::NoMerkleHash,
+    dro::CheckpointStorage<64>>;
+
+// Temporary output path, removed by the caller
+std::string externalBuildPath() {
+  char path[] = "/tmp/dro-external-build-XXXXXX";
+  int fd      = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  return path;
+}
+
+template <typename Tree>
+void externalRecover(Tree& tree, const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  assert(fd >= 0);
+  tree.recover(fd);
+  close(fd);
+}
+
+template <typename Balance, typename MaxSize = uint32_t>
+void runExternalBuildRandomTest(int range, int count,
+                                std::size_t runElements) {
+  using Map = ExternalFlatMap<Balance, MaxSize>;
+  std::vector<std::pair<int, int>> input;
+  std::map<int, int> stlmap;
+  for (int i {}; i < count; ++i) {
+    int rd = rand() % range;
+    input.emplace_back(rd, i);
+    stlmap.emplace(rd, i);
+  }
+  std::string path = externalBuildPath();
+  dro::build_external<Map>(input.begin(), input.end(), path, runElements);
+  Map flatmap;
+  externalRecover(flatmap, path);
+  unlink(path.c_str());
+  validateBalance<Balance>(flatmap);
+  assert(flatmap.size() == stlmap.size());
+  auto stlIt = stlmap.begin();
+  for (const auto& elem : flatmap) {
+    assert(elem.first == stlIt->first && elem.second == stlIt->second);
+    ++stlIt;
+  }
+  // The recovered tree takes further changes
+  for (int i {}; i < 2'000; ++i) {
+    int rd = rand() % (range + 100);
+    if (rd % 3) {
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    } else {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    }
+  }
+  validateBalance<Balance>(flatmap);
+  for (const auto& [key, value] : stlmap) { assert(flatmap.at(key) == value); }
+}
+
+void runExternalBuildTests() {
+
+  // Many runs with duplicates across runs, and a single run
+  runExternalBuildRandomTest<dro::RedBlackBalance>(5'000, 20'000, 300);
+  runExternalBuildRandomTest<dro::RedBlackBalance>(100'000, 20'000, 1);
+  runExternalBuildRandomTest<dro::RedBlackBalance>(5'000, 3'000, 1 << 20);
+  runExternalBuildRandomTest<dro::TopDownRedBlackBalance>(5'000, 20'000, 700);
+  runExternalBuildRandomTest<dro::AVLBalance>(5'000, 20'000, 700);
+  runExternalBuildRandomTest<dro::WAVLBalance>(5'000, 20'000, 700);
+
+  // Default size_t MaxSize, the recovered map takes inserts and erases
+  runExternalBuildRandomTest<dro::RedBlackBalance, std::size_t>(5'000, 20'000,
+                                                                 300);
+  runExternalBuildRandomTest<dro::AVLBalance, std::size_t>(5'000, 20'000, 700);
+
+  // Every size up to a few full levels colors a valid red black tree
+  for (int size {}; size < 70; ++size) {
+    std::vector<std::pair<int, int>> input;
+    for (int i {}; i < size; ++i) { input.emplace_back(size - i, i); }
+    std::string path = externalBuildPath();
+    dro::build_external<ExternalFlatMap<dro::RedBlackBalance>>(
+        input.begin(), input.end(), path, 16);
+    ExternalFlatMap<dro::RedBlackBalance> flatmap;
+    externalRecover(flatmap, path);
+    unlink(path.c_str());
+    validateRedBlack(flatmap);
+    assert(flatmap.size() == static_cast<std::size_t>(size));
+  }
+
+  // Sets take keys, the empty tree recovers empty
+  {
+    using ExternalFlatSet =
+        dro::FlatSet<int, uint32_t, std::greater<int>,
+                     std::allocator<dro::details::Node<
+                         dro::details::FlatSetPair<int>, uint32_t>>,
+                     dro::NoLookupIndex, dro::RedBlackBalance,
+                     dro::EagerErase, dro::NoMerkleHash,
+                     dro::CheckpointStorage<64>>;
+    std::vector<int> input;
+    std::set<int, std::greater<int>> stlset;
+    for (int i {}; i < 5'000; ++i) {
+      input.push_back(rand() % 1'000);
+      stlset.insert(input.back());
+    }
+    std::string path = externalBuildPath();
+    dro::build_external<ExternalFlatSet>(input.begin(), input.end(), path,
+                                         100);
+    ExternalFlatSet flatset;
+    externalRecover(flatset, path);
+    std::set<int, std::greater<int>> recovered(flatset.begin(), flatset.end());
+    assert(recovered == stlset);
+    input.clear();
+    dro::build_external<ExternalFlatSet>(input.begin(), input.end(), path);
+    externalRecover(flatset, path);
+    unlink(path.c_str());
+    assert(flatset.empty() && flatset.begin() == flatset.end());
+    flatset.insert(1);
+    assert(flatset.contains(1));
+  }
+}
@@ -0,0 +1,213 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+template <typename Balance, typename Erase = dro::EagerErase>
+using LayoutFlatMap = dro::FlatMap<
+    int, int, uint32_t, std::less<int>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<int, int>, uint32_t>>,
+    dro::NoLookupIndex, Balance, Erase>;
+
+// Sum and max of the depths below node, by recursion
+template <typename Tree>
+void layoutDepths(const Tree& tree, std::size_t node, std::size_t depth,
+                  std::size_t& sum, std::size_t& max) {
+  if (node == tree.empty_index_) {
+    return;
+  }
+  sum += depth;
+  max  = std::max(max, depth);
+  layoutDepths(tree, tree.tree_[node].left_, depth + 1, sum, max);
+  layoutDepths(tree, tree.tree_[node].right_, depth + 1, sum, max);
+}
+
+template <typename Tree> void validateLayout(const Tree& tree) {
+  auto report       = tree.layout_report();
+  std::size_t nodes = tree.size() + tree.tombstones_.count();
+  assert(report.nodes_ == nodes);
+  if (! nodes) {
+    assert(! report.height_ && ! report.maxDepth_ && ! report.blackHeight_);
+    return;
+  }
+  std::size_t sum {};
+  std::size_t max {};
+  layoutDepths(tree, tree.root_, 0, sum, max);
+  assert(report.maxDepth_ == max && report.height_ == max + 1);
+  assert(std::abs(report.averageDepth_ * static_cast<double>(nodes) -
+                  static_cast<double>(sum)) < 0.5);
+  assert(std::accumulate(report.heapDistance_.begin(),
+                         report.heapDistance_.end(), std::size_t {}) ==
+         nodes - 1);
+  // A page crossing crosses a cache line too
+  assert(report.pageCrossings_ <= report.cacheLineCrossings_);
+  assert(report.cacheLineCrossings_ >= 0 && report.cacheLineCrossings_ <= 1);
+  assert(report.inOrderAdjacent_ >= 0 && report.inOrderAdjacent_ <= 1);
+  assert(report.inOrderSameLine_ >= 0 && report.inOrderSameLine_ <= 1);
+}
+
+// Rows of the CSV dump match the links and the in-order walk, the DOT dump
+// has a node per slot and an edge per link
+template <typename Tree> void validateDump(const Tree& tree) {
+  std::ostringstream csv;
+  tree.dump_layout(csv);
+  std::istringstream lines(csv.str());
+  std::string line;
+  std::getline(lines, line);
+  assert(line.starts_with("index,digest,parent,left,right,"));
+  std::size_t nodes = tree.size() + tree.tombstones_.count();
+  std::vector<long long> parents(nodes), lefts(nodes), rights(nodes);
+  std::vector<std::size_t> depths(nodes), ranks(nodes);
+  std::size_t rows {};
+  auto slot = [&tree](auto index) {
+    return (index == tree.empty_index_) ? -1LL : static_cast<long long>(index);
+  };
+  for (; std::getline(lines, line); ++rows) {
+    std::istringstream row(line);
+    std::string field;
+    std::vector<std::string> fields;
+    while (std::getline(row, field, ',')) { fields.push_back(field); }
+    assert(fields.size() == 9);
+    auto index = std::stoull(fields[0]);
+    assert(index == rows);
+    parents[index] = std::stoll(fields[2]);
+    lefts[index]   = std::stoll(fields[3]);
+    rights[index]  = std::stoll(fields[4]);
+    depths[index]  = std::stoull(fields[6]);
+    ranks[index]   = std::stoull(fields[7]);
+    assert(lefts[index] == slot(tree.tree_[index].left_));
+    assert(rights[index] == slot(tree.tree_[index].right_));
+    assert(std::stoi(fields[8]) == tree.tombstones_.dead(index));
+  }
+  assert(rows == nodes);
+  for (std::size_t index {}; index < nodes; ++index) {
+    if (parents[index] < 0) {
+      assert(slot(tree.root_) == static_cast<long long>(index));
+      assert(depths[index] == 0);
+      continue;
+    }
+    auto parent = static_cast<std::size_t>(parents[index]);
+    assert(lefts[parent] == static_cast<long long>(index) ||
+           rights[parent] == static_cast<long long>(index));
+    assert(depths[index] == depths[parent] + 1);
+    // Left subtrees rank below their parent, right subtrees above
+    assert((lefts[parent] == static_cast<long long>(index)) ==
+           (ranks[index] < ranks[parent]));
+  }
+  // In-order ranks are a permutation of the slots
+  std::vector<bool> seen(nodes);
+  for (auto value : ranks) {
+    assert(value < nodes && ! seen[value]);
+    seen[value] = true;
+  }
+
+  std::ostringstream dot;
+  tree.dump_layout(dot, dro::LayoutFormat::DOT);
+  std::string graph = dot.str();
+  assert(graph.starts_with("digraph") && graph.ends_with("}\n"));
+  std::size_t labels {};
+  std::size_t edges {};
+  for (std::size_t pos {}; (pos = graph.find("[label=", pos)) != graph.npos;
+       ++pos) {
+    ++labels;
+  }
+  for (std::size_t pos {}; (pos = graph.find(" -> ", pos)) != graph.npos;
+       ++pos) {
+    ++edges;
+  }
+  assert(labels == nodes && edges == (nodes ? nodes - 1 : 0));
+  // Dead nodes keep their fill
+  std::size_t dashed {};
+  for (std::size_t pos {};
+       (pos = graph.find("style=\"filled,dashed\"", pos)) != graph.npos;
+       ++pos) {
+    ++dashed;
+  }
+  assert(dashed == tree.tombstones_.count());
+}
+
+template <typename Tree> void runLayoutRandomTest(int range, int iters) {
+  Tree flatmap;
+  validateLayout(flatmap);
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rand() % 3) {
+      flatmap[rd] = i;
+    } else {
+      flatmap.erase(rd);
+    }
+    if (i % 97 == 0) {
+      validateLayout(flatmap);
+    }
+    if (i % 1'999 == 0) {
+      validateDump(flatmap);
+    }
+  }
+  validateLayout(flatmap);
+  validateDump(flatmap);
+}
+
+void runLayoutTests() {
+
+  runLayoutRandomTest<LayoutFlatMap<dro::RedBlackBalance>>(2'000, 20'000);
+  runLayoutRandomTest<LayoutFlatMap<dro::TopDownRedBlackBalance>>(2'000,
+                                                                  20'000);
+  runLayoutRandomTest<LayoutFlatMap<dro::AVLBalance>>(2'000, 20'000);
+  runLayoutRandomTest<LayoutFlatMap<dro::WAVLBalance>>(2'000, 20'000);
+  runLayoutRandomTest<
+      LayoutFlatMap<dro::RedBlackBalance, dro::LazyErase<>>>(2'000, 20'000);
+
+  // Signed MaxSize
+  {
+    dro::FlatMap<int, int, int> flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[rand() % 2'000] = i; }
+    validateLayout(flatmap);
+    validateDump(flatmap);
+  }
+
+  // Every path of a red black tree has the black height of the left spine
+  {
+    LayoutFlatMap<dro::RedBlackBalance> flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[rand()] = i; }
+    auto report = flatmap.layout_report();
+    for (auto node = flatmap.root_; node != flatmap.empty_index_;
+         node      = flatmap.tree_[node].right_) {
+      report.blackHeight_ -= flatmap.tree_[node].color_;
+    }
+    assert(report.blackHeight_ == 0);
+    assert(report.height_ <= 2 * std::bit_width(1'000u));
+  }
+
+  // A root with two children in the heap slots
+  {
+    dro::FlatSet<int, uint8_t> flatset;
+    flatset.insert(2);
+    flatset.insert(1);
+    flatset.insert(3);
+    auto report = flatset.layout_report();
+    assert(report.nodes_ == 3 && report.height_ == 2);
+    assert(report.heapDistance_[0] == 2 && report.blackHeight_ == 1);
+    assert(report.averageDepth_ * 3 == 2 && report.inOrderAdjacent_ == 0.5);
+  }
+}
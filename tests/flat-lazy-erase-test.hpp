@@ -0,0 +1,131 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+
+template <typename Balance, typename Lookup = dro::NoLookupIndex>
+using LazyFlatMap = dro::FlatMap<
+    int, int, uint32_t, std::less<int>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<int, int>, uint32_t>>,
+    Lookup, Balance, dro::LazyErase<25>>;
+
+template <typename Map>
+void checkLazyMap(const Map& flatmap, const std::map<int, int>& stlmap,
+                  int range) {
+  assert(flatmap.size() == stlmap.size());
+  assert(flatmap.empty() == stlmap.empty());
+  // Tombstones never exceed the purge threshold
+  assert(flatmap.tombstones_.count() * 100 <=
+         (flatmap.size() + flatmap.tombstones_.count()) * 25);
+  auto stlIt = stlmap.begin();
+  for (const auto& elem : flatmap) {
+    assert(elem.first == stlIt->first && elem.second == stlIt->second);
+    ++stlIt;
+  }
+  assert(stlIt == stlmap.end());
+  auto stlRevIt = stlmap.rbegin();
+  for (auto it = flatmap.rbegin(); it != flatmap.rend(); ++it) {
+    assert(it->first == stlRevIt->first);
+    ++stlRevIt;
+  }
+  for (int i {}; i < range; ++i) {
+    assert(flatmap.contains(i) == stlmap.contains(i));
+    auto flatLb = flatmap.lower_bound(i);
+    auto stlLb  = stlmap.lower_bound(i);
+    assert((flatLb == flatmap.end()) == (stlLb == stlmap.end()));
+    if (stlLb != stlmap.end()) {
+      assert(flatLb->first == stlLb->first);
+    }
+    auto flatUb = flatmap.upper_bound(i);
+    auto stlUb  = stlmap.upper_bound(i);
+    assert((flatUb == flatmap.end()) == (stlUb == stlmap.end()));
+    if (stlUb != stlmap.end()) {
+      assert(flatUb->first == stlUb->first);
+    }
+  }
+}
+
+template <typename Map> void runLazyEraseRandomTest(int range, int iters) {
+  Map flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rd % 2) {
+      // Re-insert of an erased key revives its node with the new value
+      auto result = flatmap.emplace(rd, i);
+      assert(result.second == stlmap.emplace(rd, i).second);
+      assert(result.first->first == rd);
+    } else {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    }
+    if (i % 1'000 == 0) {
+      checkLazyMap(flatmap, stlmap, range);
+    }
+  }
+  checkLazyMap(flatmap, stlmap, range);
+  flatmap.purge();
+  assert(flatmap.tombstones_.count() == 0);
+  checkLazyMap(flatmap, stlmap, range);
+  // Erase by iterator skips tombstones for the returned iterator
+  while (! flatmap.empty()) {
+    auto stlNext = stlmap.erase(stlmap.begin());
+    auto next    = flatmap.erase(flatmap.begin());
+    assert((next == flatmap.end()) == (stlNext == stlmap.end()));
+    if (stlNext != stlmap.end()) {
+      assert(next->first == stlNext->first);
+    }
+  }
+  assert(flatmap.begin() == flatmap.end());
+}
+
+void runLazyEraseTests() {
+  runLazyEraseRandomTest<LazyFlatMap<dro::RedBlackBalance>>(500, 10'000);
+  runLazyEraseRandomTest<LazyFlatMap<dro::TopDownRedBlackBalance>>(500,
+                                                                   10'000);
+  runLazyEraseRandomTest<LazyFlatMap<dro::WAVLBalance>>(500, 10'000);
+  runLazyEraseRandomTest<
+      LazyFlatMap<dro::RedBlackBalance, dro::HashLookupIndex<>>>(500, 10'000);
+
+  // Cancel and replace, the same keys are erased and inserted again
+  {
+    LazyFlatMap<dro::RedBlackBalance> flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[i] = i; }
+    for (int round {}; round < 10; ++round) {
+      for (int i {}; i < 1'000; i += 3) { assert(flatmap.erase(i) == 1); }
+      for (int i {}; i < 1'000; i += 3) { flatmap[i] = round; }
+      assert(flatmap.size() == 1'000);
+    }
+    assert(flatmap.at(999) == 9 && flatmap.at(998) == 998);
+    flatmap.clear();
+    assert(flatmap.empty() && ! flatmap.contains(1));
+  }
+
+  // Set, every key erased
+  {
+    dro::FlatSet<int, uint32_t, std::less<int>,
+                 std::allocator<dro::details::Node<
+                     dro::details::FlatSetPair<int>, uint32_t>>,
+                 dro::NoLookupIndex, dro::RedBlackBalance, dro::LazyErase<50>>
+        flatset;
+    for (int i {}; i < 100; ++i) { flatset.insert(i); }
+    for (int i {}; i < 100; ++i) { assert(flatset.erase(i) == 1); }
+    assert(flatset.empty() && flatset.begin() == flatset.end());
+    assert(flatset.insert(5).second && *flatset.begin() == 5);
+  }
+}
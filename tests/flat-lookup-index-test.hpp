@@ -0,0 +1,114 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <set>
+
+void runLookupIndexTests() {
+
+  // Hash index stays in sync through rotations, swaps and erase relocations
+  {
+    dro::FlatMap<int, int, uint32_t, std::less<int>,
+                 std::allocator<dro::details::Node<std::pair<int, int>,
+                                                   uint32_t>>,
+                 dro::HashLookupIndex<>>
+        flatmap;
+    std::map<int, int> stlmap;
+    const int iters = 20'000;
+    for (int i {}; i < iters; ++i) {
+      int rd = rand() % (iters / 2);
+      if (rd % 3) {
+        flatmap[rd] = i;
+        stlmap[rd]  = i;
+      } else {
+        assert(flatmap.erase(rd) == stlmap.erase(rd));
+      }
+    }
+    assert(flatmap.size() == stlmap.size());
+    for (int i {}; i < iters / 2; ++i) {
+      auto it = stlmap.find(i);
+      if (it == stlmap.end()) {
+        assert(! flatmap.contains(i));
+        assert(flatmap.find(i) == flatmap.end());
+      } else {
+        assert(flatmap.at(i) == it->second);
+      }
+    }
+    auto stlIt = stlmap.begin();
+    for (const auto& elem : flatmap) {
+      assert(elem.first == stlIt->first);
+      ++stlIt;
+    }
+    // Iterator erase
+    while (! flatmap.empty()) {
+      int key = flatmap.begin()->first;
+      flatmap.erase(flatmap.begin());
+      assert(! flatmap.contains(key));
+    }
+    flatmap[1] = 1;
+    flatmap.clear();
+    assert(! flatmap.contains(1));
+  }
+
+  {
+    dro::FlatSet<int, uint16_t, std::greater<int>,
+                 std::allocator<
+                     dro::details::Node<dro::details::FlatSetPair<int>,
+                                        uint16_t>>,
+                 dro::HashLookupIndex<>>
+        flatset;
+    std::set<int> stlset;
+    flatset.reserve(1'000);
+    for (int i {}; i < 5'000; ++i) {
+      int rd = rand() % 1'000;
+      if (rd % 2) {
+        assert(flatset.insert(rd).second == stlset.insert(rd).second);
+      } else {
+        assert(flatset.erase(rd) == stlset.erase(rd));
+      }
+    }
+    for (int i {}; i < 1'000; ++i) {
+      assert(flatset.contains(i) == stlset.contains(i));
+    }
+  }
+
+  // Bloom filter rejects absent keys and survives growth and erase
+  {
+    dro::FlatMap<int, int, uint32_t, std::less<int>,
+                 std::allocator<dro::details::Node<std::pair<int, int>,
+                                                   uint32_t>>,
+                 dro::BloomLookupFilter<>>
+        flatmap;
+    std::map<int, int> stlmap;
+    for (int i {}; i < 20'000; ++i) {
+      int rd = rand() % 10'000;
+      if (rd % 4) {
+        flatmap[rd] = i;
+        stlmap[rd]  = i;
+      } else {
+        assert(flatmap.erase(rd) == stlmap.erase(rd));
+      }
+    }
+    for (int i {}; i < 20'000; ++i) {
+      assert(flatmap.contains(i) == stlmap.contains(i));
+    }
+    flatmap.reserve(100'000);
+    for (const auto& elem : stlmap) {
+      assert(flatmap.at(elem.first) == elem.second);
+    }
+    flatmap.clear();
+    assert(! flatmap.contains(stlmap.begin()->first));
+  }
+}
@@ -0,0 +1,135 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Value holding a heap buffer, counted through a HeapBytes specialization
+struct MemoryBuffer {
+  std::vector<char> bytes_;
+};
+
+template <> struct dro::HeapBytes<MemoryBuffer> {
+  constexpr static bool owns_ = true;
+
+  std::size_t operator()(const MemoryBuffer& buffer) const noexcept {
+    return buffer.bytes_.capacity() + 1'000;
+  }
+};
+
+template <typename Tree> void validateMemory(const Tree& tree) {
+  using node_type       = typename Tree::node_type;
+  auto memory           = tree.memory_usage();
+  std::size_t nodes     = tree.size() + tree.tombstones_.count();
+  std::size_t allocated = tree.tree_.capacity() * sizeof(node_type);
+  assert(memory.object_ == sizeof(Tree));
+  assert(memory.nodes_ == nodes * sizeof(node_type));
+  assert(memory.deadCapacity_ == allocated - memory.nodes_);
+  assert(memory.padding_ <= memory.nodes_);
+  assert(memory.total_ == memory.object_ + allocated + memory.allocator_ +
+                              memory.heap_ + memory.policies_);
+}
+
+void runMemoryTests() {
+
+  // Short strings live in the object, long strings on the heap
+  {
+    dro::FlatMap<int, std::string> flatmap;
+    validateMemory(flatmap);
+    assert(! flatmap.memory_usage().heap_);
+    std::size_t heap {};
+    for (int i {}; i < 1'000; ++i) {
+      flatmap[i] = (i % 2) ? std::string(1, 'x') : std::string(100, 'y');
+      heap += (i % 2) ? 0 : flatmap[i].capacity() + 1;
+    }
+    auto memory = flatmap.memory_usage();
+    assert(memory.heap_ == heap);
+    validateMemory(flatmap);
+    for (int i {}; i < 1'000; i += 2) { flatmap.erase(i); }
+    assert(! flatmap.memory_usage().heap_);
+    validateMemory(flatmap);
+    assert(flatmap.memory_usage().deadCapacity_ > memory.deadCapacity_);
+  }
+
+  // Signed MaxSize
+  {
+    dro::FlatMap<int, int, int> flatmap;
+    for (int i {}; i < 100; ++i) { flatmap[i] = i; }
+    validateMemory(flatmap);
+  }
+
+  // A node of an int key and 8 bit links has no padding
+  {
+    dro::FlatSet<int, uint8_t> flatset;
+    for (int i {}; i < 100; ++i) { flatset.insert(i); }
+    auto memory = flatset.memory_usage();
+    assert(! memory.padding_ && ! memory.heap_);
+    validateMemory(flatset);
+  }
+
+  // Values counted through the trait, tombstones count as nodes
+  {
+    dro::FlatMap<
+        int, MemoryBuffer, uint32_t, std::less<int>,
+        std::allocator<
+            dro::details::Node<std::pair<int, MemoryBuffer>, uint32_t>>,
+        dro::NoLookupIndex, dro::RedBlackBalance, dro::LazyErase<>>
+        flatmap;
+    for (int i {}; i < 10; ++i) { flatmap[i].bytes_.resize(10); }
+    flatmap.erase(0);
+    auto memory = flatmap.memory_usage();
+    assert(memory.heap_ >= 10 * 1'010);
+    validateMemory(flatmap);
+  }
+
+  // Policy heap counts in the total, the allocator of the node storage
+  // decides the overhead whatever the Allocator parameter names
+  {
+    dro::FlatMap<int, int> plain;
+    dro::FlatMap<int, int, std::size_t, std::less<int>,
+                 std::allocator<
+                     dro::details::Node<std::pair<int, int>, std::size_t>>,
+                 dro::HashLookupIndex<>, dro::RedBlackBalance,
+                 dro::LazyErase<>, dro::MerkleHash<>,
+                 dro::CheckpointStorage<64>, dro::TopKeyCache<2>,
+                 dro::NoStats, dro::UndoSavepoints>
+        flatmap;
+    // The default allocator parameter names Node, AVL stores RankNode
+    dro::FlatMap<int, int, std::size_t, std::less<int>,
+                 std::allocator<
+                     dro::details::Node<std::pair<int, int>, std::size_t>>,
+                 dro::NoLookupIndex, dro::AVLBalance>
+        avlmap;
+    for (int i {}; i < 1'000; ++i) {
+      plain[i]   = i;
+      flatmap[i] = i;
+      avlmap[i]  = i;
+    }
+    flatmap.erase(0);
+    auto savepoint = flatmap.savepoint();
+    flatmap[5'000] = 1;
+    assert(flatmap.digest() && flatmap.contains(1));
+    assert(! plain.memory_usage().policies_);
+    auto memory = flatmap.memory_usage();
+    // Hash slots and digest sums take at least a word per node
+    assert(memory.policies_ >= 1'000 * sizeof(std::uint64_t));
+    validateMemory(flatmap);
+    validateMemory(avlmap);
+#if defined(__GLIBC__)
+    assert(memory.allocator_ && avlmap.memory_usage().allocator_);
+#endif
+    flatmap.rollback(savepoint);
+    validateMemory(flatmap);
+  }
+}
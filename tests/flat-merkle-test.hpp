@@ -0,0 +1,205 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+template <typename Erase>
+using MerkleFlatMap = dro::FlatMap<
+    int, int, uint32_t, std::less<int>,
+    std::allocator<dro::details::Node<std::pair<int, int>, uint32_t>>,
+    dro::NoLookupIndex, dro::RedBlackBalance, Erase, dro::MerkleHash<>>;
+
+// Returns the digest of the subtree, checks it against the cached sum
+template <typename Tree, typename Index>
+std::uint64_t validateDigestNode(const Tree& tree, Index node) {
+  if (node == tree.empty_index_) {
+    return 0;
+  }
+  const auto& nodeRef = tree.tree_[node];
+  std::uint64_t sum   = validateDigestNode(tree, nodeRef.left_) +
+                      validateDigestNode(tree, nodeRef.right_);
+  // A tombstone hashes to zero
+  if (! tree.tombstones_.dead(node)) {
+    sum += decltype(tree.digest_)::hash(nodeRef.pair_);
+  }
+  assert(tree.digest_.sums_[node] == sum);
+  return sum;
+}
+
+template <typename Tree> void validateDigest(const Tree& tree) {
+  std::uint64_t digest = tree.digest();
+  assert(validateDigestNode(tree, tree.root_) == digest);
+}
+
+// Keys present in one map only or with different values
+std::vector<int> expectedDiff(const std::map<int, int>& lhs,
+                              const std::map<int, int>& rhs) {
+  std::map<int, bool> keys;
+  for (const auto& [key, value] : lhs) {
+    auto it   = rhs.find(key);
+    keys[key] = (it == rhs.end() || it->second != value);
+  }
+  for (const auto& [key, value] : rhs) {
+    keys[key] = keys[key] || ! lhs.contains(key);
+  }
+  std::vector<int> result;
+  for (const auto& [key, differs] : keys) {
+    if (differs) {
+      result.push_back(key);
+    }
+  }
+  return result;
+}
+
+template <typename Erase> void runMerkleRandomTest(int range, int iters) {
+  MerkleFlatMap<Erase> flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rd % 3 == 0) {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    } else if (rd % 3 == 1) {
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    } else {
+      flatmap.insert_or_assign(rd, -i);
+      stlmap.insert_or_assign(rd, -i);
+    }
+    if (i % 89 == 0) {
+      validateDigest(flatmap);
+    }
+  }
+  validateDigest(flatmap);
+
+  // Replica built in another order from the same elements
+  MerkleFlatMap<Erase> replica;
+  for (auto it = stlmap.rbegin(); it != stlmap.rend(); ++it) {
+    replica.emplace(it->first, it->second);
+  }
+  assert(dro::equal(flatmap, replica));
+  assert(dro::diff(flatmap, replica).empty());
+
+  // Changed values, missing keys on both sides and extra keys
+  std::map<int, int> stlReplica = stlmap;
+  for (int i {}; i < 20; ++i) {
+    int rd = rand() % (range + 100);
+    if (rd % 3 == 0) {
+      replica.erase(rd);
+      stlReplica.erase(rd);
+    } else if (rd % 3 == 1 && replica.contains(rd)) {
+      replica.at(rd) += 1;
+      stlReplica[rd] += 1;
+    } else {
+      replica[rd]    = i;
+      stlReplica[rd] = i;
+    }
+  }
+  validateDigest(replica);
+  auto keys = dro::diff(flatmap, replica);
+  assert(keys == expectedDiff(stlmap, stlReplica));
+  assert(dro::diff(replica, flatmap) == keys);
+  assert(dro::equal(flatmap, replica) == keys.empty());
+}
+
+void runMerkleTests() {
+
+  runMerkleRandomTest<dro::EagerErase>(64, 2'000);
+  runMerkleRandomTest<dro::EagerErase>(5'000, 20'000);
+  runMerkleRandomTest<dro::LazyErase<>>(5'000, 20'000);
+
+  // Empty maps and clear
+  {
+    MerkleFlatMap<dro::EagerErase> lhs, rhs;
+    assert(dro::equal(lhs, rhs) && lhs.digest() == 0);
+    lhs[1] = 1;
+    assert(! dro::equal(lhs, rhs));
+    assert(dro::diff(lhs, rhs) == std::vector<int> {1});
+    lhs.clear();
+    assert(dro::equal(lhs, rhs));
+  }
+
+  // The element (0, 0) and the key 0 of a set are not absent
+  {
+    MerkleFlatMap<dro::EagerErase> lhs, rhs;
+    lhs[1] = 1;
+    rhs[1] = 1;
+    rhs[0] = 0;
+    assert(lhs.digest() != rhs.digest() && ! dro::equal(lhs, rhs));
+    assert(dro::diff(lhs, rhs) == std::vector<int> {0});
+    dro::FlatSet<int, uint32_t, std::less<int>,
+                 std::allocator<dro::details::Node<
+                     dro::details::FlatSetPair<int>, uint32_t>>,
+                 dro::NoLookupIndex, dro::RedBlackBalance, dro::EagerErase,
+                 dro::MerkleHash<>>
+        five, zeroFive;
+    five.insert(5);
+    zeroFive.insert(0);
+    zeroFive.insert(5);
+    assert(five.digest() != zeroFive.digest());
+    assert(dro::diff(five, zeroFive) == std::vector<int> {0});
+  }
+
+  // Values written through non-const iterators are summed again
+  {
+    MerkleFlatMap<dro::EagerErase> lhs, rhs;
+    for (int i {}; i < 100; ++i) {
+      lhs[i] = i;
+      rhs[i] = i;
+    }
+    lhs.find(7)->second = 8;
+    assert(! dro::equal(lhs, rhs));
+    assert(dro::diff(lhs, rhs) == std::vector<int> {7});
+    (*rhs.find(7)).second = 8;
+    assert(dro::equal(lhs, rhs));
+    for (auto& [key, value] : lhs) { value += 1; }
+    validateDigest(lhs);
+    assert(dro::diff(lhs, rhs).size() == 100);
+  }
+
+  // Many values assigned through references fall back to a full rebuild
+  {
+    MerkleFlatMap<dro::EagerErase> lhs, rhs;
+    for (int i {}; i < 1'000; ++i) {
+      lhs[i] = i;
+      rhs[i] = i;
+    }
+    for (int i {}; i < 1'000; ++i) { lhs[i] += 1; }
+    validateDigest(lhs);
+    assert(dro::diff(lhs, rhs).size() == 1'000);
+    for (int i {}; i < 1'000; ++i) { rhs.at(i) += 1; }
+    assert(dro::equal(lhs, rhs));
+  }
+
+  // Sets hash the keys only
+  {
+    dro::FlatSet<int, uint32_t, std::greater<int>,
+                 std::allocator<dro::details::Node<
+                     dro::details::FlatSetPair<int>, uint32_t>>,
+                 dro::NoLookupIndex, dro::RedBlackBalance, dro::EagerErase,
+                 dro::MerkleHash<>>
+        lhs, rhs;
+    for (int i {}; i < 2'000; ++i) {
+      lhs.insert(i);
+      rhs.insert(1'999 - i);
+    }
+    assert(dro::equal(lhs, rhs));
+    lhs.erase(7);
+    rhs.erase(9);
+    validateDigest(lhs);
+    assert((dro::diff(lhs, rhs) == std::vector<int> {9, 7}));
+  }
+}
@@ -0,0 +1,98 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-radix-map.hpp"
+// Must precede <map>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+template <typename Key, typename MaxSize>
+void runRadixMapRandomTest(Key range, Key offset) {
+  dro::FlatRadixMap<Key, int, MaxSize> radixmap;
+  std::map<Key, int> stlmap;
+  for (int i {}; i < 20'000; ++i) {
+    Key key = static_cast<Key>(static_cast<Key>(rand()) % range - offset);
+    if (rand() % 3) {
+      radixmap[key] = i;
+      stlmap[key]   = i;
+    } else {
+      assert(radixmap.erase(key) == stlmap.erase(key));
+    }
+  }
+  assert(radixmap.size() == stlmap.size());
+  auto stlIt = stlmap.begin();
+  for (const auto& elem : radixmap) {
+    assert(elem.first == stlIt->first);
+    assert(elem.second == stlIt->second);
+    ++stlIt;
+  }
+  assert(stlIt == stlmap.end());
+  for (int i {}; i < 5'000; ++i) {
+    Key key       = static_cast<Key>(static_cast<Key>(rand()) % range - offset);
+    auto expected = stlmap.lower_bound(key);
+    auto result   = radixmap.lower_bound(key);
+    if (expected == stlmap.end()) {
+      assert(result == radixmap.end());
+    } else {
+      assert(result->first == expected->first);
+    }
+    auto expectedUpper = stlmap.upper_bound(key);
+    auto resultUpper   = radixmap.upper_bound(key);
+    if (expectedUpper == stlmap.end()) {
+      assert(resultUpper == radixmap.end());
+    } else {
+      assert(resultUpper->first == expectedUpper->first);
+    }
+    assert(radixmap.contains(key) == stlmap.contains(key));
+  }
+  // Iterator erase down to empty
+  while (! radixmap.empty()) {
+    auto next = radixmap.erase(radixmap.begin());
+    stlmap.erase(stlmap.begin());
+    assert(next == radixmap.begin());
+  }
+  assert(radixmap.begin() == radixmap.end());
+}
+
+void runFlatRadixMapTests() {
+  runRadixMapRandomTest<uint64_t, std::size_t>(5'000, 0);
+  runRadixMapRandomTest<uint64_t, uint32_t>(
+      std::numeric_limits<uint32_t>::max(), 0);
+  runRadixMapRandomTest<int32_t, uint32_t>(2'000, 1'000);
+  runRadixMapRandomTest<int16_t, uint32_t>(20'000, 10'000);
+
+  // Sparse 64 bit keys, path compression
+  {
+    dro::FlatRadixMap<uint64_t, int> radixmap;
+    const uint64_t max = std::numeric_limits<uint64_t>::max();
+    radixmap[max]        = 1;
+    radixmap[0]          = 2;
+    radixmap[1ULL << 63] = 3;
+    radixmap.emplace((1ULL << 63) + 1, 4);
+    assert(radixmap.size() == 4);
+    assert(radixmap.at(max) == 1);
+    assert(radixmap.lower_bound(1)->first == (1ULL << 63));
+    assert(radixmap.upper_bound(max) == radixmap.end());
+    assert(! radixmap.insert({0, 5}).second);
+    assert(radixmap.at(0) == 2);
+    try {
+      radixmap.at(5);
+      assert(false);// Should never reach
+    } catch (std::out_of_range& e) {
+      assert(true);// Should always reach
+    }
+    radixmap.clear();
+    assert(radixmap.empty());
+    assert(radixmap.find(max) == radixmap.end());
+  }
+}
@@ -20,7 +20,22 @@
 #include <bits/stl_function.h>
 
 #include "dro/flat-rb-tree.hpp"
+#include "elias-fano-set-test.hpp"
+#include "flat-balance-test.hpp"
+#include "flat-checkpoint-test.hpp"
+#include "flat-export-test.hpp"
+#include "flat-external-build-test.hpp"
+#include "flat-layout-test.hpp"
+#include "flat-lazy-erase-test.hpp"
+#include "flat-lookup-index-test.hpp"
+#include "flat-memory-test.hpp"
+#include "flat-merkle-test.hpp"
+#include "flat-radix-map-test.hpp"
+#include "flat-savepoint-test.hpp"
 #include "flat-set-test.hpp"
+#include "flat-stats-test.hpp"
+#include "flat-top-cache-test.hpp"
+#include "learned-flat-map-test.hpp"
 #include "stl_tree_public.h"
 
 namespace dro::details {
@@ -232,6 +247,49 @@ int main() {
   // FlatSet
   runFlatSetTests();
 
+  // Lookup Policies
+  runLookupIndexTests();
+
+  // Balance Policies
+  runBalanceTests();
+
+  // Top Cache
+  runTopCacheTests();
+
+  // Stats
+  runStatsTests();
+
+  // Layout
+  runLayoutTests();
+
+  // Memory
+  runMemoryTests();
+
+  // Erase Policies
+  runLazyEraseTests();
+
+  // Merkle Digests
+  runMerkleTests();
+
+  // Savepoints
+  runSavepointTests();
+
+  // Checkpoints
+  runCheckpointTests();
+
+  // Bulk Export
+  runExportTests();
+
+  // External Build
+  runExternalBuildTests();
+
+  // Frozen Maps
+  runLearnedFlatMapTests();
+  runEliasFanoSetTests();
+
+  // FlatRadixMap
+  runFlatRadixMapTests();
+
   // Constructors
   {
     dro::FlatMap<int, int> flatmap(10);
@@ -309,6 +367,18 @@ int main() {
     assert(cflatmap.size() == 1);
   }
 
+  // Reserve keeps its capacity, the next doubling grows from it
+  {
+    dro::FlatMap<int, int> flatmap;
+    flatmap.reserve(100);
+    assert(flatmap.capacity() == 100);
+    for (int i {}; i < 100; ++i) { flatmap[i] = i; }
+    assert(flatmap.capacity() == 100);
+    flatmap[100] = 100;
+    assert(flatmap.capacity() == 200 && flatmap.size() == 101);
+    for (int i {}; i <= 100; ++i) { assert(flatmap.at(i) == i); }
+  }
+
   // Modifiers
   {
     dro::FlatMap<int, int> flatmap(10);
@@ -392,6 +462,21 @@ int main() {
     assert(flatmap.cbegin() == flatmap.cend());
   }
 
+  {
+    dro::FlatMap<int, int> flatmap(10);
+    flatmap[1] = 1;
+    flatmap[2] = 2;
+    flatmap[3] = 3;
+    flatmap.erase_and_discard(flatmap.end());
+    flatmap.erase_and_discard(flatmap.begin());
+    assert(flatmap.size() == 2);
+    assert(flatmap.begin()->first == 2);
+    flatmap.erase_and_discard(flatmap.cbegin());
+    flatmap.erase_and_discard(flatmap.find(3));
+    assert(flatmap.empty());
+    assert(flatmap.begin() == flatmap.end());
+  }
+
   {
     dro::FlatMap<int, int> flatmap1(10), flatmap2(10);
     flatmap1[1] = 1;
@@ -0,0 +1,169 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template <typename Lookup = dro::NoLookupIndex,
+          typename Balance = dro::RedBlackBalance,
+          typename Erase = dro::EagerErase, typename Merkle = dro::NoMerkleHash>
+using SavepointFlatMap = dro::FlatMap<
+    int, int, uint32_t, std::less<int>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<int, int>, uint32_t>>,
+    Lookup, Balance, Erase, Merkle, dro::VectorStorage, dro::NoTopCache,
+    dro::NoStats, dro::UndoSavepoints>;
+
+template <typename Tree>
+concept SavepointTree = requires(Tree& tree) {
+  tree.rollback(tree.savepoint());
+};
+
+template <typename Tree>
+void checkSavepointMap(const Tree& flatmap, const std::map<int, int>& stlmap) {
+  assert(flatmap.size() == stlmap.size());
+  auto stlIt = stlmap.begin();
+  for (const auto& elem : flatmap) {
+    assert(elem.first == stlIt->first && elem.second == stlIt->second);
+    ++stlIt;
+  }
+}
+
+// Random changes under nested savepoints, rolled back or released at random
+template <typename Tree> void runSavepointRandomTest(int range, int rounds) {
+  Tree flatmap;
+  std::map<int, int> stlmap;
+  std::vector<std::map<int, int>> snapshots;
+  for (int round {}; round < rounds; ++round) {
+    int action = rand() % 4;
+    if (action == 0 || snapshots.empty()) {
+      assert(flatmap.savepoint() == snapshots.size());
+      snapshots.push_back(stlmap);
+    } else if (action == 1) {
+      auto sp = static_cast<std::size_t>(rand()) % snapshots.size();
+      flatmap.rollback(sp);
+      stlmap = snapshots[sp];
+      snapshots.resize(sp + 1);
+      checkSavepointMap(flatmap, stlmap);
+    } else if (action == 2) {
+      auto sp = static_cast<std::size_t>(rand()) % snapshots.size();
+      flatmap.release(sp);
+      snapshots.resize(sp);
+    }
+    for (int i {}; i < 50; ++i) {
+      int rd = rand() % range;
+      if (rd % 4 == 0) {
+        assert(flatmap.erase(rd) == stlmap.erase(rd));
+      } else if (rd % 4 == 1) {
+        flatmap[rd] = i;
+        stlmap[rd]  = i;
+      } else if (rd % 4 == 2 && stlmap.contains(rd)) {
+        flatmap.at(rd) += 1;
+        stlmap[rd] += 1;
+      } else {
+        flatmap.insert_or_assign(rd, -i);
+        stlmap.insert_or_assign(rd, -i);
+      }
+    }
+  }
+  while (! snapshots.empty()) {
+    flatmap.rollback(snapshots.size() - 1);
+    stlmap = snapshots.back();
+    checkSavepointMap(flatmap, stlmap);
+    flatmap.release(snapshots.size() - 1);
+    snapshots.pop_back();
+  }
+  checkSavepointMap(flatmap, stlmap);
+}
+
+void runSavepointTests() {
+
+  runSavepointRandomTest<SavepointFlatMap<>>(200, 300);
+  runSavepointRandomTest<SavepointFlatMap<>>(5'000, 300);
+  runSavepointRandomTest<SavepointFlatMap<
+      dro::HashLookupIndex<>, dro::RedBlackBalance, dro::LazyErase<>>>(500,
+                                                                       300);
+  runSavepointRandomTest<
+      SavepointFlatMap<dro::NoLookupIndex, dro::WAVLBalance>>(500, 300);
+
+  // Digests return to the savepoint, clear is undone
+  {
+    using MerkleMap =
+        SavepointFlatMap<dro::NoLookupIndex, dro::RedBlackBalance,
+                         dro::EagerErase, dro::MerkleHash<>>;
+    MerkleMap flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[i] = i; }
+    MerkleMap copy   = flatmap;
+    auto sp          = flatmap.savepoint();
+    flatmap[5]       = 6;
+    flatmap[2'000]   = 1;
+    flatmap.erase(7);
+    assert(! dro::equal(flatmap, copy));
+    flatmap.rollback(sp);
+    assert(dro::equal(flatmap, copy));
+    flatmap.clear();
+    assert(flatmap.empty());
+    flatmap.rollback(sp);
+    assert(dro::equal(flatmap, copy) && flatmap.at(999) == 999);
+    flatmap.release(sp);
+    bool thrown {};
+    try {
+      flatmap.rollback(sp);
+    } catch (const std::out_of_range&) { thrown = true; }
+    assert(thrown);
+  }
+
+  // Sets log keys only
+  {
+    dro::FlatSet<int, std::size_t, std::less<int>,
+                 std::allocator<dro::details::Node<
+                     dro::details::FlatSetPair<int>, std::size_t>>,
+                 dro::NoLookupIndex, dro::RedBlackBalance, dro::EagerErase,
+                 dro::NoMerkleHash, dro::VectorStorage, dro::NoTopCache,
+                 dro::NoStats, dro::UndoSavepoints>
+        flatset;
+    for (int i {}; i < 100; ++i) { flatset.insert(i); }
+    auto sp = flatset.savepoint();
+    for (int i {}; i < 100; i += 2) { flatset.erase(i); }
+    for (int i = 100; i < 200; ++i) { flatset.insert(i); }
+    flatset.rollback(sp);
+    std::set<int> expected;
+    for (int i {}; i < 100; ++i) { expected.insert(i); }
+    assert(std::set<int>(flatset.begin(), flatset.end()) == expected);
+  }
+
+  // Without the policy nothing is logged, move only values compile and clear
+  // cannot throw
+  {
+    dro::FlatMap<int, std::unique_ptr<int>> flatmap;
+    static_assert(! SavepointTree<decltype(flatmap)>);
+    static_assert(SavepointTree<SavepointFlatMap<>>);
+    static_assert(noexcept(flatmap.clear()));
+    // The log and the savepoint marks are two vectors
+    static_assert(sizeof(dro::FlatMap<int, int, uint32_t>) +
+                      2 * sizeof(std::vector<std::size_t>) ==
+                  sizeof(SavepointFlatMap<>));
+    flatmap[1] = std::make_unique<int>(1);
+    assert(*flatmap.at(1) == 1);
+    flatmap.erase(1);
+    flatmap[2] = std::make_unique<int>(2);
+    flatmap.clear();
+    assert(flatmap.empty());
+  }
+}
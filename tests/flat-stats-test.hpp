@@ -0,0 +1,217 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <utility>
+
+template <typename Balance, typename Erase = dro::EagerErase>
+using StatsFlatMap = dro::FlatMap<
+    int, int, uint32_t, std::less<int>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<int, int>, uint32_t>>,
+    dro::NoLookupIndex, Balance, Erase, dro::NoMerkleHash,
+    dro::VectorStorage, dro::NoTopCache, dro::OperationStats>;
+
+template <typename Tree>
+concept StatsTree = requires(Tree& tree) {
+  tree.stats();
+  tree.reset_stats();
+};
+
+// Top down trees rebalance on the way down, without fix loops
+template <typename Tree, bool FixLoops = true>
+void runStatsRandomTest(int range, int iters) {
+  Tree flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rand() % 3) {
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    } else {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    }
+  }
+  auto stats = flatmap.stats();
+  assert(stats.comparisons_ && stats.searches_ && stats.depth_);
+  assert(stats.rotations_ && stats.relocations_ && stats.resizes_);
+  assert(! FixLoops || (stats.fixInsert_ && stats.fixErase_));
+
+  // Every find of a present key visits at least one node, at most the height
+  flatmap.reset_stats();
+  stats = flatmap.stats();
+  assert(! stats.comparisons_ && ! stats.searches_ && ! stats.depth_);
+  assert(! stats.rotations_ && ! stats.relocations_ && ! stats.resizes_);
+  const Tree& constmap = flatmap;
+  for (const auto& [key, value] : stlmap) {
+    assert(constmap.find(key)->second == value);
+  }
+  stats = flatmap.stats();
+  assert(stats.searches_ == stlmap.size());
+  assert(stats.depth_ >= stlmap.size());
+  assert(stats.depth_ <= stlmap.size() * 2 * std::bit_width(stlmap.size()));
+  assert(! stats.rotations_ && ! stats.fixInsert_ && ! stats.fixErase_);
+}
+
+void runStatsTests() {
+
+  runStatsRandomTest<StatsFlatMap<dro::RedBlackBalance>>(2'000, 20'000);
+  runStatsRandomTest<StatsFlatMap<dro::TopDownRedBlackBalance>, false>(
+      2'000, 20'000);
+  runStatsRandomTest<StatsFlatMap<dro::AVLBalance>>(2'000, 20'000);
+  runStatsRandomTest<StatsFlatMap<dro::WAVLBalance>>(2'000, 20'000);
+
+  // Sorted inserts hit the extrema cache after the first, the capacity
+  // doubles from one
+  {
+    StatsFlatMap<dro::RedBlackBalance> flatmap;
+    for (int i {}; i < 1'024; ++i) { flatmap[i] = i; }
+    auto stats = flatmap.stats();
+    assert(stats.extremaHits_ == 1'023 && stats.resizes_ == 10);
+    assert(stats.rotations_ && stats.rotations_ < 1'024);
+    flatmap.reset_stats();
+    for (int i {}; i < 512; ++i) { flatmap.erase(i * 2); }
+    stats = flatmap.stats();
+    assert(stats.relocations_ && stats.fixErase_ && ! stats.extremaHits_);
+  }
+
+  // Finding the root compares once for equality, reserve reallocates once
+  {
+    StatsFlatMap<dro::RedBlackBalance> flatmap;
+    flatmap[1] = 1;
+    flatmap.reset_stats();
+    assert(flatmap.contains(1));
+    assert(flatmap.stats().comparisons_ == 1);
+    flatmap.reserve(100);
+    assert(flatmap.stats().resizes_ == 1);
+  }
+
+  // Phase times of the bottom up insert and erase, every phase runs once per
+  // insert or found erase, reset_stats clears them
+  {
+    using PhaseFlatMap = dro::FlatMap<
+        int, int, uint32_t, std::less<int>,
+        std::allocator<dro::details::Node<std::pair<int, int>, uint32_t>>,
+        dro::NoLookupIndex, dro::RedBlackBalance, dro::EagerErase,
+        dro::NoMerkleHash, dro::VectorStorage, dro::NoTopCache,
+        dro::PhaseStats>;
+    using dro::details::FlatTreePhase;
+    PhaseFlatMap flatmap;
+    for (int i {}; i < 1'000; ++i) { flatmap[i * 7 % 1'000] = i; }
+    for (int i {}; i < 500; ++i) { assert(flatmap.erase(i * 2)); }
+    assert(! flatmap.erase(-1));
+    auto times = flatmap.phase_times();
+    for (auto phase :
+         {FlatTreePhase::InsertExtrema, FlatTreePhase::InsertLocation,
+          FlatTreePhase::InsertResize, FlatTreePhase::InsertInit}) {
+      assert(times[phase].count_ == 1'000);
+    }
+    // The root is inserted without a fix
+    assert(times[FlatTreePhase::InsertFix].count_ == 999);
+    assert(times[FlatTreePhase::EraseFind].count_ == 501);
+    for (auto phase :
+         {FlatTreePhase::EraseNeighbors, FlatTreePhase::EraseUnlink,
+          FlatTreePhase::EraseSwap, FlatTreePhase::EraseFix}) {
+      assert(times[phase].count_ == 500);
+    }
+    for (const auto& phase : times.phases_) {
+      std::uint64_t runs {};
+      for (auto bucket : phase.histogram_) { runs += bucket; }
+      assert(runs == phase.count_);
+    }
+    assert(flatmap.stats().rotations_);
+    flatmap.reset_stats();
+    assert(! flatmap.phase_times()[FlatTreePhase::InsertFix].count_);
+    assert(! flatmap.stats().rotations_);
+  }
+
+  // Iterators of trees without parent links keep the path from the root, a
+  // full iteration compares keys only for the search of the first path
+  {
+    StatsFlatMap<dro::TopDownRedBlackBalance> flatmap;
+    // The path is out of line
+    static_assert(sizeof(decltype(flatmap)::iterator) <= 64);
+    std::map<int, int> stlmap;
+    for (int i {}; i < 4'096; ++i) {
+      int rd      = rand() % 10'000;
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    }
+    std::size_t height = 2 * std::bit_width(stlmap.size());
+    for (auto begin : {flatmap.begin(), flatmap.find(stlmap.begin()->first)}) {
+      flatmap.reset_stats();
+      auto stlIt = stlmap.begin();
+      for (auto it = begin; it != flatmap.end(); ++it, ++stlIt) {
+        assert(it->first == stlIt->first);
+      }
+      assert(stlIt == stlmap.end());
+      assert(flatmap.stats().comparisons_ <= height);
+    }
+    flatmap.reset_stats();
+    auto stlRevIt = stlmap.rbegin();
+    for (auto it = flatmap.rbegin(); it != flatmap.rend(); ++it, ++stlRevIt) {
+      assert(it->first == stlRevIt->first);
+    }
+    assert(flatmap.stats().comparisons_ <= height);
+    // Steps back and forth from the middle
+    auto middle = std::next(stlmap.begin(), 2'000);
+    auto it     = flatmap.find(middle->first);
+    for (int i {}; i < 100; ++i) {
+      if (i % 3) {
+        ++it;
+        ++middle;
+      } else {
+        --it;
+        --middle;
+      }
+      assert(it->first == middle->first);
+    }
+  }
+
+  // Without a stats policy the counters compile away
+  {
+    dro::FlatMap<int, int> flatmap;
+    static_assert(! StatsTree<decltype(flatmap)>);
+    static_assert(StatsTree<StatsFlatMap<dro::AVLBalance>>);
+    flatmap[1] = 1;
+    assert(flatmap.at(1) == 1);
+  }
+
+#ifdef DRO_FLAT_PROBE_COUNTS
+  // The probes count depth and rotations without a stats policy, the same
+  // per call as the stats of an identical tree
+  {
+    dro::FlatMap<int, int> flatmap;
+    StatsFlatMap<dro::RedBlackBalance> statsmap;
+    dro::details::FlatTreeStats start = dro::details::flatTreeProbeCounts;
+    for (int i {}; i < 1'000; ++i) { flatmap[rand() % 2'000] = i; }
+    dro::details::FlatTreeStats end = dro::details::flatTreeProbeCounts;
+    assert(end.depth_ > start.depth_);
+    assert(end.rotations_ > start.rotations_);
+    srand(1);
+    flatmap.clear();
+    start = dro::details::flatTreeProbeCounts;
+    for (int i {}; i < 1'000; ++i) { flatmap[rand() % 2'000] = i; }
+    end = dro::details::flatTreeProbeCounts;
+    srand(1);
+    for (int i {}; i < 1'000; ++i) { statsmap[rand() % 2'000] = i; }
+    assert(end.depth_ - start.depth_ == statsmap.stats().depth_);
+    assert(end.rotations_ - start.rotations_ == statsmap.stats().rotations_);
+  }
+#endif
+}
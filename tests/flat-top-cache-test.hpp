@@ -0,0 +1,170 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+// Must precede <map> and <set>, shares the include guard of bits/stl_tree.h
+#include "stl_tree_public.h"
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Balance, typename Erase = dro::EagerErase>
+using TopCacheFlatMap = dro::FlatMap<
+    int, int, uint32_t, std::less<int>,
+    std::allocator<typename dro::details::FlatTreeBalance<
+        Balance>::template node_type<std::pair<int, int>, uint32_t>>,
+    dro::NoLookupIndex, Balance, Erase, dro::NoMerkleHash,
+    dro::VectorStorage, dro::TopKeyCache<3>>;
+
+// Cached keys and slots match the top of the tree, the marked slots are the
+// cached ones
+template <typename Tree> void validateTopCache(const Tree& tree) {
+  const auto& cache = tree.topCache_;
+  using cache_type  = std::remove_cvref_t<decltype(cache)>;
+  if (tree.size() + tree.tombstones_.count() < cache_type::threshold_) {
+    return;
+  }
+  assert(! cache.stale_);
+  std::size_t marked {};
+  for (std::size_t pos {}; pos < cache_type::inner_ * 2 + 1; ++pos) {
+    // Slot reached from the root by the path of pos
+    auto node        = tree.root_;
+    std::size_t heap = pos + 1;
+    for (int bit = std::bit_width(heap) - 2;
+         bit >= 0 && node != tree.empty_index_; --bit) {
+      node = ((heap >> bit) & 1) ? tree.tree_[node].right_
+                                 : tree.tree_[node].left_;
+    }
+    auto cached = (pos < cache_type::inner_)
+                      ? cache.entries_[pos].node_
+                      : cache.frontier_[pos - cache_type::inner_];
+    assert(cached == node);
+    if (node != tree.empty_index_) {
+      assert(cache.top_[node]);
+      ++marked;
+      if (pos < cache_type::inner_) {
+        assert(cache.entries_[pos].key_ == tree.tree_[node].pair_.first);
+      }
+    }
+  }
+  std::size_t bits {};
+  for (bool bit : cache.top_) { bits += bit; }
+  assert(bits == marked);
+}
+
+template <typename Tree> void runTopCacheRandomTest(int range, int iters) {
+  Tree flatmap;
+  std::map<int, int> stlmap;
+  for (int i {}; i < iters; ++i) {
+    int rd = rand() % range;
+    if (rd % 3) {
+      flatmap[rd] = i;
+      stlmap[rd]  = i;
+    } else if (rd % 2) {
+      assert(flatmap.erase(rd) == stlmap.erase(rd));
+    } else {
+      auto it = flatmap.find(rd);
+      assert((it == flatmap.end()) == ! stlmap.contains(rd));
+      if (it != flatmap.end()) {
+        flatmap.erase(it);
+        stlmap.erase(rd);
+      }
+    }
+    if (i % 37 == 0) {
+      validateTopCache(flatmap);
+    }
+  }
+  validateTopCache(flatmap);
+  for (int i = -1; i <= range; ++i) {
+    assert(flatmap.contains(i) == stlmap.contains(i));
+    auto lower    = flatmap.lower_bound(i);
+    auto upper    = flatmap.upper_bound(i);
+    auto stlLower = stlmap.lower_bound(i);
+    auto stlUpper = stlmap.upper_bound(i);
+    assert((lower == flatmap.end()) == (stlLower == stlmap.end()));
+    assert((upper == flatmap.end()) == (stlUpper == stlmap.end()));
+    if (stlLower != stlmap.end()) {
+      assert(lower->first == stlLower->first);
+    }
+    if (stlUpper != stlmap.end()) {
+      assert(upper->first == stlUpper->first);
+    }
+  }
+  // Falls back to the tree below the threshold
+  while (flatmap.size() > 10) {
+    assert(flatmap.erase(flatmap.begin()->first));
+    stlmap.erase(stlmap.begin());
+    validateTopCache(flatmap);
+  }
+  for (const auto& [key, value] : stlmap) { assert(flatmap.at(key) == value); }
+}
+
+void runTopCacheTests() {
+
+  runTopCacheRandomTest<TopCacheFlatMap<dro::RedBlackBalance>>(2'000, 20'000);
+  runTopCacheRandomTest<TopCacheFlatMap<dro::TopDownRedBlackBalance>>(
+      2'000, 20'000);
+  runTopCacheRandomTest<TopCacheFlatMap<dro::AVLBalance>>(2'000, 20'000);
+  runTopCacheRandomTest<TopCacheFlatMap<dro::WAVLBalance>>(2'000, 20'000);
+  runTopCacheRandomTest<
+      TopCacheFlatMap<dro::RedBlackBalance, dro::LazyErase<>>>(2'000, 20'000);
+
+  // Sorted inserts rotate at the top, clear empties the cache
+  {
+    TopCacheFlatMap<dro::RedBlackBalance> flatmap;
+    for (int i {}; i < 5'000; ++i) {
+      flatmap[i] = i;
+      if (i % 101 == 0) {
+        validateTopCache(flatmap);
+      }
+    }
+    assert(flatmap.find(4'999)->second == 4'999);
+    flatmap.clear();
+    assert(flatmap.topCache_.stale_ && ! flatmap.contains(1));
+    for (int i = 1'000; i > 0; --i) { flatmap[i] = i; }
+    validateTopCache(flatmap);
+    assert(flatmap.lower_bound(0)->first == 1);
+  }
+
+  // Searches through the cache visit the nodes of the same searches without
+  // it, the shapes are the same
+  {
+    using StatsMap = dro::FlatMap<
+        int, int, uint32_t, std::less<int>,
+        std::allocator<dro::details::Node<std::pair<int, int>, uint32_t>>,
+        dro::NoLookupIndex, dro::RedBlackBalance, dro::EagerErase,
+        dro::NoMerkleHash, dro::VectorStorage, dro::NoTopCache,
+        dro::OperationStats>;
+    using CachedStatsMap = dro::FlatMap<
+        int, int, uint32_t, std::less<int>,
+        std::allocator<dro::details::Node<std::pair<int, int>, uint32_t>>,
+        dro::NoLookupIndex, dro::RedBlackBalance, dro::EagerErase,
+        dro::NoMerkleHash, dro::VectorStorage, dro::TopKeyCache<3>,
+        dro::OperationStats>;
+    StatsMap plain;
+    CachedStatsMap cached;
+    for (int i {}; i < 1'000; ++i) {
+      int rd     = rand() % 4'000;
+      plain[rd]  = i;
+      cached[rd] = i;
+    }
+    validateTopCache(cached);
+    plain.reset_stats();
+    cached.reset_stats();
+    for (int i = -10; i < 4'010; ++i) {
+      assert(plain.contains(i) == cached.contains(i));
+    }
+    assert(plain.stats().depth_ == cached.stats().depth_);
+  }
+}
@@ -0,0 +1,113 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "dro/flat-rb-tree.hpp"
+#include "dro/learned-flat-map.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template <typename Map>
+void checkLearnedLowerBound(const Map& learned,
+                            const std::vector<std::int64_t>& keys,
+                            std::int64_t key) {
+  auto expected = std::lower_bound(keys.begin(), keys.end(), key);
+  auto result   = learned.lower_bound(key);
+  if (expected == keys.end()) {
+    assert(result == learned.end());
+  } else {
+    assert(result != learned.end());
+    assert(result->first == *expected);
+  }
+}
+
+void runLearnedFlatMapTests() {
+
+  // Timestamps with jitter, a smooth distribution
+  {
+    dro::FlatMap<std::int64_t, int, uint32_t> flatmap;
+    std::vector<std::int64_t> keys;
+    std::int64_t timestamp = 1'700'000'000'000;
+    for (int i {}; i < 50'000; ++i) {
+      timestamp += 1'000 + rand() % 100;
+      flatmap[timestamp] = i;
+      keys.push_back(timestamp);
+    }
+    dro::LearnedFlatMap<std::int64_t, int, 16> learned(flatmap);
+    assert(learned.size() == flatmap.size());
+    assert(learned.segments() < keys.size() / 16);
+    for (std::size_t i {}; i < keys.size(); ++i) {
+      assert(learned.at(keys[i]) == static_cast<int>(i));
+      assert(! learned.contains(keys[i] + 1));
+      checkLearnedLowerBound(learned, keys, keys[i] - 1);
+      checkLearnedLowerBound(learned, keys, keys[i] + 1);
+    }
+    checkLearnedLowerBound(learned, keys,
+                           std::numeric_limits<std::int64_t>::min());
+    checkLearnedLowerBound(learned, keys,
+                           std::numeric_limits<std::int64_t>::max());
+    assert(learned.upper_bound(keys[0])->first == keys[1]);
+    assert(std::is_sorted(learned.begin(), learned.end(),
+                          [](const auto& lhs, const auto& rhs) {
+                            return lhs.first < rhs.first;
+                          }));
+  }
+
+  // Random keys in reverse order, built from a descending map
+  {
+    dro::FlatMap<std::int64_t, int, uint32_t, std::greater<std::int64_t>>
+        flatmap;
+    for (int i {}; i < 20'000; ++i) {
+      flatmap[static_cast<std::int64_t>(rand()) * (rand() % 3 - 1)] = i;
+    }
+    std::vector<std::int64_t> keys;
+    for (const auto& elem : flatmap) { keys.push_back(elem.first); }
+    std::reverse(keys.begin(), keys.end());
+    dro::LearnedFlatMap<std::int64_t, int> learned(flatmap);
+    for (int i {}; i < 20'000; ++i) {
+      checkLearnedLowerBound(learned, keys,
+                             static_cast<std::int64_t>(rand()) *
+                                 (rand() % 3 - 1));
+    }
+    try {
+      [[maybe_unused]] auto value = learned.at(keys.back() + 1);
+      assert(false);// Should never reach
+    } catch (std::out_of_range& e) {
+      assert(true);// Should always reach
+    }
+  }
+
+  // Duplicate keys keep the first pair, the model stays finite
+  {
+    std::vector<std::pair<std::int64_t, int>> pairs;
+    std::vector<std::int64_t> keys;
+    for (int i {}; i < 10'000; ++i) {
+      pairs.emplace_back((i % 5'000) * 7, i);
+      keys.push_back(i * 7);
+    }
+    keys.resize(5'000);
+    dro::LearnedFlatMap<std::int64_t, int, 4> learned(pairs);
+    assert(learned.size() == 5'000);
+    for (int i {}; i < 5'000; ++i) {
+      assert(learned.at(i * 7) == i);
+      checkLearnedLowerBound(learned, keys, i * 7 + 1);
+    }
+  }
+
+  {
+    dro::LearnedFlatMap<std::uint64_t, int> learned;
+    assert(learned.empty());
+    assert(learned.lower_bound(1) == learned.end());
+    assert(! learned.contains(1));
+  }
+}